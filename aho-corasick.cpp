@@ -0,0 +1,36 @@
+#ifndef RECCHECK
+#include <vector>
+#endif
+
+#include "aho-corasick.h"
+
+// Breadth-first over the trie, so a node's failure link (which is shallower)
+// is always final before the node's children need it.
+AhoCorasick::AhoCorasick(const Trie& dict)
+    : dict_(dict),
+      fail_(dict.nodeCount(), dict.root()),
+      dictLink_(dict.nodeCount(), Trie::npos),
+      depth_(dict.nodeCount(), 0)
+{
+    const TrieNode* nodes = dict.nodes();
+    std::vector<NodeIndex> queue(1, dict.root());
+    for(size_t head = 0; head < queue.size(); head++){
+        NodeIndex u = queue[head];
+        uint32_t mask = nodes[u].childMask & ~Trie::WORD_BIT;
+        NodeIndex v = nodes[u].firstChild;
+        for(; mask; mask &= mask - 1, v++){
+            char c = 'A' + __builtin_ctz(mask);
+            depth_[v] = depth_[u] + 1;
+            if(u != dict.root()){
+                NodeIndex f = fail_[u];
+                while(f != dict.root() && dict.child(f, c) == Trie::npos)
+                    f = fail_[f];
+                NodeIndex t = dict.child(f, c);
+                fail_[v] = t != Trie::npos ? t : dict.root();
+            }
+            NodeIndex f = fail_[v];
+            dictLink_[v] = dict.isWord(f) ? f : dictLink_[f];
+            queue.push_back(v);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef AHO_CORASICK_H
+#define AHO_CORASICK_H
+
+#ifndef RECCHECK
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#endif
+
+#include "trie.h"
+
+// Aho-Corasick automaton over a Trie: the trie nodes are the states, and
+// each gets a failure link (the longest proper suffix that is also a trie
+// node) and a dictionary link (the nearest word-ending state along the
+// failure chain). One left-to-right pass over a string then reports every
+// dictionary word occurring in it. The trie must outlive the automaton.
+class AhoCorasick {
+public:
+    typedef Trie::NodeIndex NodeIndex;
+
+    explicit AhoCorasick(const Trie& dict);
+
+    // Call match(end, length) for every word occurrence in s[0, len), where
+    // the word is s[end-length+1 .. end]. Occurrences come in order of end,
+    // and longest first among those sharing an end.
+    template <typename Match>
+    void scan(const char* s, size_t len, Match match) const
+    {
+        NodeIndex state = dict_.root();
+        for(size_t i = 0; i < len; i++){
+            state = next(state, s[i]);
+            NodeIndex w = dict_.isWord(state) ? state : dictLink_[state];
+            for(; w != Trie::npos; w = dictLink_[w])
+                match(i, depth_[w]);
+        }
+    }
+
+    const Trie& trie() const { return dict_; }
+
+private:
+    // goto function: the trie child, else retry from the failure link
+    NodeIndex next(NodeIndex state, char c) const
+    {
+        for(;;){
+            NodeIndex t = dict_.child(state, c);
+            if(t != Trie::npos)
+                return t;
+            if(state == dict_.root())
+                return state;
+            state = fail_[state];
+        }
+    }
+
+    const Trie& dict_;
+    std::vector<NodeIndex> fail_;
+    std::vector<NodeIndex> dictLink_;
+    std::vector<uint16_t> depth_;
+};
+
+#endif
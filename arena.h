@@ -0,0 +1,141 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+#include "ht.h"
+
+// ------------------------------- Arena -------------------------------------
+//
+// A bump allocator over a list of slabs. Each allocation takes the next
+// (aligned) bytes of the current slab; when it is full, a new slab twice
+// the size of the last (up to MAX_SLAB) is started. A request too big for
+// a slab of its own size class gets a slab to itself. Nothing is freed
+// until the arena is destroyed or reset(), which release every slab at
+// once, so a table built once costs a handful of large allocations.
+//
+// Not thread-safe; one arena per table (or per thread) is the intent.
+
+class Arena {
+public:
+    static const size_t MIN_SLAB = 4096;
+    static const size_t MAX_SLAB = 1 << 20;
+
+    Arena() : cur_(nullptr), end_(nullptr), next_(MIN_SLAB), bytes_(0) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { reset(); }
+
+    void* allocate(size_t n, size_t align = alignof(std::max_align_t)) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~uintptr_t(align - 1);
+        if (!cur_ || p + n > reinterpret_cast<uintptr_t>(end_)) {
+            if (n + align > next_ / 4)
+                return bigSlab(n, align);
+            newSlab();
+            p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~uintptr_t(align - 1);
+        }
+        cur_ = reinterpret_cast<char*>(p + n);
+        bytes_ += n;
+        return reinterpret_cast<void*>(p);
+    }
+
+    // Free every slab. Anything allocated from the arena is gone.
+    void reset() {
+        for (char* s : slabs_) std::free(s);
+        slabs_.clear();
+        cur_ = end_ = nullptr;
+        next_ = MIN_SLAB;
+        bytes_ = 0;
+    }
+
+    size_t slabs() const { return slabs_.size(); }
+    // bytes handed out, padding excluded
+    size_t bytesAllocated() const { return bytes_; }
+
+private:
+    void newSlab() {
+        cur_ = static_cast<char*>(std::malloc(next_));
+        if (!cur_) throw std::bad_alloc();
+        slabs_.push_back(cur_);
+        end_ = cur_ + next_;
+        if (next_ < MAX_SLAB) next_ *= 2;
+    }
+
+    // its own slab; the current one stays open for small requests
+    void* bigSlab(size_t n, size_t align) {
+        char* s = static_cast<char*>(std::malloc(n + align));
+        if (!s) throw std::bad_alloc();
+        slabs_.push_back(s);
+        bytes_ += n;
+        uintptr_t p = (reinterpret_cast<uintptr_t>(s) + align - 1) & ~uintptr_t(align - 1);
+        return reinterpret_cast<void*>(p);
+    }
+
+    char*              cur_;
+    char*              end_;
+    size_t             next_;
+    size_t             bytes_;
+    std::vector<char*> slabs_;
+};
+
+// --------------------------- ArenaAllocator --------------------------------
+//
+// A standard allocator drawing from an Arena that the caller owns and that
+// must outlive everything allocated from it. deallocate() does nothing.
+// There is no default constructor: every container and string using one is
+// handed the arena explicitly, as with std::pmr.
+
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena* arena) : arena_(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) {}
+
+    Arena* arena() const { return arena_; }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena_ == other.arena(); }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena_ != other.arena(); }
+
+private:
+    Arena* arena_;
+};
+
+// Strings whose bytes live in an arena. A HashTable keyed on ArenaString
+// and using an ArenaAllocator keeps both its items and its key bytes in one
+// arena: build each key with ArenaString(s, table.get_allocator()).
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > ArenaString;
+
+// Whether destroying a T only releases arena memory (so skipping it leaks
+// nothing): true for trivially destructible types, for strings on an
+// ArenaAllocator, and for pairs of such.
+template <typename T>
+struct ArenaReleasable : std::is_trivially_destructible<T> {};
+template <typename C, typename Tr, typename U>
+struct ArenaReleasable<std::basic_string<C, Tr, ArenaAllocator<U> > > : std::true_type {};
+template <typename A, typename B>
+struct ArenaReleasable<std::pair<A, B> >
+    : std::integral_constant<bool, ArenaReleasable<A>::value && ArenaReleasable<B>::value> {};
+
+// A HashTable on an arena whose items are ArenaReleasable is destroyed in
+// O(1): the arena takes the items with it.
+template <typename T, typename Item>
+struct SkipItemDestroy<ArenaAllocator<T>, Item> : ArenaReleasable<Item> {};
+
+#endif // ARENA_H
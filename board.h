@@ -0,0 +1,69 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#ifndef RECCHECK
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+#endif
+
+// An n x n board of letters in one buffer. Each row is followed by a '\0'
+// cell, and a row of '\0' follows the last row, so a walk right, down or
+// down-right from any cell reaches a '\0' before it leaves the buffer:
+// solvers stop on the sentinel instead of checking r and c against n.
+class Board {
+public:
+    Board() : n_(0), cells_(1, '\0') {}
+    explicit Board(unsigned n) { resize(n); }
+
+    // Adapter for the old std::vector<std::vector<char> > interface; the
+    // rows must all have rows.size() letters. Both directions copy every
+    // cell, so neither is implicit.
+    explicit Board(const std::vector<std::vector<char> >& rows)
+    {
+        resize(rows.size());
+        for(unsigned i = 0; i < n_; i++){
+            if(rows[i].size() != n_)
+                throw std::invalid_argument("board is not square");
+            for(unsigned j = 0; j < n_; j++)
+                (*this)(i, j) = rows[i][j];
+        }
+    }
+
+    explicit operator std::vector<std::vector<char> >() const
+    {
+        std::vector<std::vector<char> > rows(n_);
+        for(unsigned i = 0; i < n_; i++)
+            rows[i].assign(row(i), row(i) + n_);
+        return rows;
+    }
+
+    // n x n cells, all '\0' until filled in; keeps the buffer when it is
+    // already large enough
+    void resize(unsigned n)
+    {
+        n_ = n;
+        cells_.assign(size_t(n + 1) * (n + 1), '\0');
+    }
+
+    unsigned size() const { return n_; }
+    // distance between vertically adjacent cells
+    size_t stride() const { return n_ + 1; }
+    // pointer offset of one step in direction (dr, dc)
+    ptrdiff_t step(int dr, int dc) const { return dr * ptrdiff_t(stride()) + dc; }
+
+    char& operator()(unsigned r, unsigned c) { return cells_[r * stride() + c]; }
+    const char& operator()(unsigned r, unsigned c) const { return cells_[r * stride() + c]; }
+    // row r as n letters followed by '\0'; r == n is the sentinel row
+    const char* row(unsigned r) const { return &cells_[r * stride()]; }
+    char* row(unsigned r) { return &cells_[r * stride()]; }
+
+    bool operator==(const Board& other) const { return n_ == other.n_ && cells_ == other.cells_; }
+    bool operator!=(const Board& other) const { return !(*this == other); }
+
+private:
+    unsigned n_;
+    std::vector<char> cells_;
+};
+
+#endif
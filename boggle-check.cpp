@@ -0,0 +1,339 @@
+//
+// Boggle solver tests: every engine must agree with the set-based solver
+//
+#include "boggle.h"
+#include <gtest/gtest.h>
+#include <iostream>
+#include <string>
+#include <set>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <fstream>
+#include <unordered_set>
+
+using namespace std;
+
+// dict.txt is loaded once for the whole suite
+class BoggleTest : public ::testing::Test {
+protected:
+	static void SetUpTestSuite(){
+		sets = new pair<set<string>, set<string> >(parseDict("dict.txt"));
+		trie = new Trie(parseDictTrie("dict.txt"));
+	}
+	static void TearDownTestSuite(){
+		delete sets;
+		delete trie;
+	}
+	static set<string> expected(const Board& board){
+		return boggle(sets->first, sets->second, board);
+	}
+	static pair<set<string>, set<string> >* sets;
+	static Trie* trie;
+};
+
+pair<set<string>, set<string> >* BoggleTest::sets = nullptr;
+Trie* BoggleTest::trie = nullptr;
+
+// parseDict as it was: formatted reads, one insert per word and prefix
+static pair<set<string>, set<string> > referenceParse(const char* fname){
+	ifstream in(fname);
+	set<string> dict, prefix;
+	string word;
+	while(in >> word){
+		dict.insert(word);
+		for(size_t i = word.size(); i > 1; --i)
+			prefix.insert(word.substr(0, i-1));
+	}
+	prefix.insert("");
+	return make_pair(dict, prefix);
+}
+
+TEST_F(BoggleTest,ParseDictMatchesReference){
+	EXPECT_EQ(*sets, referenceParse("dict.txt"));
+
+	// unsorted, duplicated, mixed case and odd whitespace
+	const char* fname = "boggle-check-words.txt";
+	{
+		ofstream out(fname);
+		out << "ZEBRA\n\tcat CAT\r\nCATS  car\n\nCA A ZEBRA Zed x1y\v\fCAT";
+	}
+	EXPECT_EQ(parseDict(fname), referenceParse(fname));
+	Trie t = parseDictTrie(fname);
+	EXPECT_EQ(t.wordCount(), 7u);
+	EXPECT_TRUE(t.contains("zed"));
+	EXPECT_FALSE(t.contains("X1Y"));
+	remove(fname);
+}
+
+TEST_F(BoggleTest,BoardLayout){
+	Board b = genBoard(5, 3);
+	ASSERT_EQ(b.size(), 5u);
+	EXPECT_EQ(b.stride(), 6u);
+	for(unsigned i = 0; i <= 5; i++){
+		EXPECT_EQ(b(i, 5), '\0') << i;
+		EXPECT_EQ(b(5, i), '\0') << i;
+	}
+	EXPECT_EQ(b.row(2)[5], '\0');
+	EXPECT_EQ(&b(3, 4) + b.step(1, 1), &b(4, 5));
+
+	// round trip through the old representation
+	vector<vector<char> > rows(b);
+	ASSERT_EQ(rows.size(), 5u);
+	EXPECT_EQ(rows[4][1], b(4, 1));
+	EXPECT_EQ(Board(rows), b);
+	EXPECT_THROW(Board(vector<vector<char> >{{'A', 'B'}, {'C'}}), std::invalid_argument);
+	EXPECT_EQ(Board(vector<vector<char> >()), Board());
+
+	// genBoard in place gives the same letters as a fresh board
+	Board reused = genBoard(9, 1);
+	genBoard(5, 3, reused);
+	EXPECT_EQ(reused, b);
+}
+
+TEST_F(BoggleTest,SetMatchesRecursiveHelper){
+	for(unsigned n = 1; n <= 40; n += 13){
+		Board board = genBoard(n, 11);
+		set<string> recursive;
+		for(unsigned i = 0; i < n; i++){
+			for(unsigned j = 0; j < n; j++){
+				boggleHelper(sets->first, sets->second, board, "", recursive, i, j, 0, 1);
+				boggleHelper(sets->first, sets->second, board, "", recursive, i, j, 1, 0);
+				boggleHelper(sets->first, sets->second, board, "", recursive, i, j, 1, 1);
+			}
+		}
+		EXPECT_EQ(expected(board), recursive) << n;
+		// starts off the board, past the sentinel border too, find nothing
+		EXPECT_FALSE(boggleHelper(sets->first, sets->second, board, "", recursive, n, 0, 0, 1));
+		EXPECT_FALSE(boggleHelper(sets->first, sets->second, board, "", recursive, 0, n + 5, 1, 1));
+		EXPECT_FALSE(boggleHelper(sets->first, sets->second, board, "", recursive, n + 5, n + 5, 1, 0));
+	}
+}
+
+TEST_F(BoggleTest,HashDictMatchesSet){
+	pair<HashDict, HashDict> hashed = parseDict<HashDict>("dict.txt");
+	EXPECT_EQ(hashed.first.size(), sets->first.size());
+	EXPECT_EQ(hashed.second.size(), sets->second.size());
+	EXPECT_TRUE(dictContains(hashed.second, ""));
+	pair<unordered_set<string>, unordered_set<string> > unordered =
+		parseDict<unordered_set<string> >("dict.txt");
+	EXPECT_EQ(unordered.second.size(), sets->second.size());
+	for(unsigned n = 1; n <= 40; n += 13){
+		Board board = genBoard(n, 21);
+		EXPECT_EQ(boggle(hashed.first, hashed.second, board), expected(board)) << n;
+		// HashTable lookups are not thread safe, so this runs serially
+		EXPECT_EQ(boggle(hashed.first, hashed.second, board, 4), expected(board)) << n;
+		EXPECT_EQ(boggle(unordered.first, unordered.second, board, 2), expected(board)) << n;
+	}
+}
+
+TEST_F(BoggleTest,ConcurrentHashDictMatchesSet){
+	pair<ConcurrentHashDict, ConcurrentHashDict> hashed = parseDict<ConcurrentHashDict>("dict.txt");
+	EXPECT_EQ(hashed.first.size(), sets->first.size());
+	EXPECT_EQ(hashed.second.size(), sets->second.size());
+	for(unsigned n = 1; n <= 40; n += 13){
+		Board board = genBoard(n, 22);
+		EXPECT_EQ(boggle(hashed.first, hashed.second, board), expected(board)) << n;
+		EXPECT_EQ(boggle(hashed.first, hashed.second, board, 4), expected(board)) << n;
+	}
+}
+
+TEST_F(BoggleTest,TrieContents){
+	EXPECT_EQ(trie->wordCount(), sets->first.size());
+	EXPECT_TRUE(trie->contains("AARDVARK"));
+	EXPECT_TRUE(trie->contains("aardvark"));
+	EXPECT_FALSE(trie->contains("AARDV"));
+	EXPECT_FALSE(trie->contains(""));
+	Trie::NodeIndex n = trie->find("AARDV");
+	ASSERT_NE(n, Trie::npos);
+	EXPECT_TRUE(trie->hasChildren(n));
+	EXPECT_EQ(trie->find("QXZ"), Trie::npos);
+}
+
+TEST_F(BoggleTest,TrieSmall){
+	Trie t(vector<string>{"CAT", "CATS", "CAR", "DOG", "CAT", "C4T", ""});
+	EXPECT_EQ(t.wordCount(), 4u);
+	// root, C, D, A, O, T, R, G, S
+	EXPECT_EQ(t.nodeCount(), 9u);
+	EXPECT_TRUE(t.contains("CATS"));
+	EXPECT_FALSE(t.contains("CA"));
+	EXPECT_FALSE(t.contains("C4T"));
+}
+
+TEST_F(BoggleTest,TrieMatchesSet){
+	for(unsigned n = 1; n <= 60; n += 7){
+		for(int seed = 0; seed < 3; seed++){
+			Board board = genBoard(n, seed);
+			EXPECT_EQ(boggle(*trie, board), expected(board)) << n << " " << seed;
+		}
+	}
+}
+
+TEST_F(BoggleTest,CompiledRoundTrip){
+	const char* fname = "boggle-check-dict.bin";
+	trie->save(fname);
+	ASSERT_TRUE(Trie::isCompiled(fname));
+	EXPECT_FALSE(Trie::isCompiled("dict.txt"));
+	{
+		Trie mapped = parseDictTrie(fname);
+		EXPECT_TRUE(mapped.isMapped());
+		EXPECT_EQ(mapped.nodeCount(), trie->nodeCount());
+		EXPECT_EQ(mapped.wordCount(), trie->wordCount());
+		Trie copy(mapped);
+		EXPECT_FALSE(copy.isMapped());
+		Trie moved(std::move(mapped));
+		EXPECT_TRUE(moved.isMapped());
+		for(int seed = 0; seed < 3; seed++){
+			Board board = genBoard(25, seed);
+			EXPECT_EQ(boggle(moved, board), expected(board)) << seed;
+			EXPECT_EQ(boggle(copy, board), expected(board)) << seed;
+		}
+	}
+	remove(fname);
+	EXPECT_THROW(Trie::load("dict.txt"), std::invalid_argument);
+
+	// a well-formed header over nodes that point outside the array
+	Trie small(vector<string>{"A", "AB", "QI"});
+	small.save(fname);
+	string bytes;
+	{
+		ifstream in(fname, ios::binary);
+		bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	}
+	auto corrupt = [&](size_t node, size_t field, uint32_t value){
+		string bad = bytes;
+		memcpy(&bad[bad.size() - (small.nodeCount() - node) * 8 + field * 4], &value, 4);
+		ofstream(fname, ios::binary) << bad;
+		EXPECT_THROW(Trie::load(fname), std::invalid_argument) << node << " " << field << " " << value;
+	};
+	EXPECT_NO_THROW(Trie::load(fname));
+	corrupt(0, 1, uint32_t(small.nodeCount()));
+	corrupt(0, 1, 0xFFFFFFFFu);
+	corrupt(small.nodeCount() - 1, 0, 1u << 27);
+	remove(fname);
+}
+
+TEST_F(BoggleTest,LinesMatchesSet){
+	// single-letter words must survive the two-letter start filter
+	Trie small(vector<string>{"A", "AB", "QI", "XYZ"});
+	Board tiny(vector<vector<char> >{{'A', 'Q'}, {'X', 'I'}});
+	EXPECT_EQ(boggleLines(small, tiny), boggle(small, tiny));
+	EXPECT_TRUE(boggleLines(*trie, Board()).empty());
+	for(unsigned n = 1; n <= 60; n += 7){
+		for(int seed = 0; seed < 3; seed++){
+			Board board = genBoard(n, seed);
+			EXPECT_EQ(boggleLines(*trie, board), expected(board)) << n << " " << seed;
+		}
+	}
+	Board board = genBoard(40, 9);
+	EXPECT_EQ(boggleLines(*trie, board, 3), expected(board));
+}
+
+TEST_F(BoggleTest,AhoCorasickScan){
+	Trie small(vector<string>{"HE", "SHE", "HERS", "HIS", "S"});
+	AhoCorasick ac(small);
+	vector<pair<size_t, unsigned> > hits;
+	string text = "USHERS";
+	ac.scan(text.data(), text.size(), [&](size_t end, unsigned len){
+		hits.push_back(make_pair(end, len));
+	});
+	vector<pair<size_t, unsigned> > want{{1, 1}, {3, 3}, {3, 2}, {5, 4}, {5, 1}};
+	EXPECT_EQ(hits, want);
+}
+
+TEST_F(BoggleTest,AhoCorasickMatchesSet){
+	AhoCorasick ac(*trie);
+	EXPECT_TRUE(boggle(ac, Board()).empty());
+	for(unsigned n = 1; n <= 60; n += 7){
+		for(int seed = 0; seed < 3; seed++){
+			Board board = genBoard(n, seed);
+			EXPECT_EQ(boggle(ac, board), expected(board)) << n << " " << seed;
+		}
+	}
+	Board board = genBoard(40, 9);
+	EXPECT_EQ(boggle(ac, board, 3), expected(board));
+}
+
+TEST_F(BoggleTest,ParallelMatchesSerial){
+	for(unsigned n : {1u, 3u, 50u}){
+		Board board = genBoard(n, 5);
+		set<string> serial = expected(board);
+		for(unsigned threads : {0u, 2u, 4u, 7u}){
+			EXPECT_EQ(boggle(sets->first, sets->second, board, threads), serial) << n << " " << threads;
+			EXPECT_EQ(boggle(*trie, board, threads), serial) << n << " " << threads;
+		}
+	}
+}
+
+TEST_F(BoggleTest,ReadBoardRoundTrip){
+	stringstream ss;
+	vector<Board> boards;
+	for(unsigned n : {4u, 1u, 9u}){
+		boards.push_back(genBoard(n, n));
+		printBoard(boards.back(), ss);
+		ss << "\n";
+	}
+	Board board;
+	for(size_t k = 0; k < boards.size(); k++){
+		ASSERT_TRUE(readBoard(ss, board));
+		EXPECT_EQ(board, boards[k]);
+	}
+	EXPECT_FALSE(readBoard(ss, board));
+
+	stringstream ragged("A B C\nD E\nF G H\n");
+	EXPECT_THROW(readBoard(ragged, board), std::invalid_argument);
+	stringstream shortBoard("A B\n");
+	EXPECT_THROW(readBoard(shortBoard, board), std::invalid_argument);
+	stringstream digit("A B\nC 4\n");
+	EXPECT_THROW(readBoard(digit, board), std::invalid_argument);
+
+	// lower case reads as upper case
+	stringstream lower("a b\nC d\n");
+	ASSERT_TRUE(readBoard(lower, board));
+	EXPECT_EQ(board, Board(vector<vector<char> >{{'A', 'B'}, {'C', 'D'}}));
+}
+
+TEST_F(BoggleTest,BatchMatchesSingle){
+	vector<set<string> > found;
+	vector<Board> seen;
+	auto sink = [&](const Board& board, const set<string>& words){
+		seen.push_back(board);
+		found.push_back(words);
+	};
+	EXPECT_EQ(boggleBatch(*trie, seedBoards(12, 40, 5), sink), 5u);
+	EXPECT_EQ(boggleBatch(sets->first, sets->second, seedBoards(12, 40, 5), sink, 2), 5u);
+	ASSERT_EQ(found.size(), 10u);
+	for(int k = 0; k < 5; k++){
+		Board board = genBoard(12, 40 + k);
+		EXPECT_EQ(seen[k], board);
+		EXPECT_EQ(found[k], expected(board)) << k;
+		EXPECT_EQ(found[k + 5], found[k]) << k;
+	}
+
+	stringstream ss;
+	printBoard(seen[0], ss);
+	printBoard(seen[3], ss);
+	found.clear();
+	seen.clear();
+	EXPECT_EQ(boggleBatch(*trie, streamBoards(ss), sink), 2u);
+	ASSERT_EQ(found.size(), 2u);
+	EXPECT_EQ(found[1], expected(genBoard(12, 43)));
+
+	// a lower-case board streamed in gets the same words from every engine
+	AhoCorasick ac(*trie);
+	const BoardSolver engines[] = {
+		[&](const Board& b){ return boggle(sets->first, sets->second, b); },
+		[&](const Board& b){ return boggle(*trie, b); },
+		[&](const Board& b){ return boggleLines(*trie, b); },
+		[&](const Board& b){ return boggle(ac, b); },
+	};
+	const set<string> ab{"AB", "AD"};
+	for(const BoardSolver& solve : engines){
+		stringstream lower("a b\nc d\n");
+		found.clear();
+		EXPECT_EQ(boggleBatch(solve, streamBoards(lower), sink), 1u);
+		ASSERT_EQ(found.size(), 1u);
+		EXPECT_EQ(found[0], ab);
+	}
+}
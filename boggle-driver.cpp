@@ -1,35 +1,190 @@
 #include <iostream>
 #include <sstream>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <set>
 #include <random>
+#include <cstring>
+#include <chrono>
 
 #include "boggle.h"
 
 using namespace std;
 
+void printResult(const Board& board, const set<string>& found)
+{
+	printBoard(board);
+	set<string>::const_iterator it;
+	stringstream os;
+	for(it=found.begin();it != found.end(); ++it)
+	{
+		os << *it << ", ";
+	}
+	cout << "Found " << found.size() << " words:" << endl;
+	cout << os.str().substr(0,os.str().size()-2) << endl;
+}
+
 int main(int argc, char* argv[])
 {
 	if(argc < 4)
 	{
-		cout << "Usage: boggle-driver <size> <seed> <dictionary file>" << endl;
+		cout << "Usage: boggle-driver <size> <seed> <dictionary file> [--engine=set|hash|chash|trie|lines|aho] [--threads=N]" << endl;
+		cout << "                     [--seeds=N | --boards=<file>|-] [--stats]" << endl;
 		exit(1);
 	}
 	int size = atoi(argv[1]);
 	int seed = atoi(argv[2]);
-	vector<vector<char> > board = genBoard(size, seed);
-	printBoard(board);
-	pair<set<string>, set<string> > parsed = parseDict(string(argv[3]));
-	set<string> dictionary = parsed.first;
-	set<string> prefix = parsed.second;
-	set<string> found = boggle(dictionary, prefix, board);
-	set<string>::iterator it;
-	stringstream os;
-	for(it=found.begin();it != found.end(); ++it)
+	// a compiled dictionary can only be used by the trie engine
+	string engine = Trie::isCompiled(argv[3]) ? "trie" : "set";
+	unsigned threads = 1;
+	// batch mode: boards from seeds seed..seed+N-1, or read from a file
+	size_t seeds = 1;
+	string boardFile;
+	// timings go to stderr so the results on stdout are unchanged
+	bool stats = false;
+	for(int i = 4; i < argc; i++)
 	{
-		os << *it << ", ";
+		if(strncmp(argv[i], "--engine=", 9) == 0)
+			engine = argv[i] + 9;
+		else if(strncmp(argv[i], "--threads=", 10) == 0)
+			threads = atoi(argv[i] + 10);
+		else if(strncmp(argv[i], "--seeds=", 8) == 0)
+			seeds = atol(argv[i] + 8);
+		else if(strncmp(argv[i], "--boards=", 9) == 0)
+			boardFile = argv[i] + 9;
+		else if(strcmp(argv[i], "--stats") == 0)
+			stats = true;
+		else
+		{
+			cout << "Unknown option: " << argv[i] << endl;
+			exit(1);
+		}
 	}
-	cout << "Found " << found.size() << " words:" << endl;
-	cout << os.str().substr(0,os.str().size()-2) << endl;
+
+	ifstream boardfs;
+	BoardSource boards = seedBoards(size, seed, seeds);
+	if(boardFile == "-")
+		boards = streamBoards(cin);
+	else if(!boardFile.empty())
+	{
+		boardfs.open(boardFile);
+		if(boardfs.fail())
+		{
+			cout << "Unable to open board file: " << boardFile << endl;
+			exit(1);
+		}
+		boards = streamBoards(boardfs);
+	}
+
+	// --stats: each setup phase runs from the end of the one before; board
+	// input and output are timed as they happen inside the batch, and the
+	// rest of the batch is search
+	typedef chrono::steady_clock Clock;
+	auto ms = [](Clock::duration d) { return chrono::duration<double, milli>(d).count(); };
+	Clock::time_point mark = Clock::now();
+	auto phase = [&](const char* name)
+	{
+		Clock::time_point now = Clock::now();
+		if(stats)
+			cerr << name << ": " << ms(now - mark) << " ms" << endl;
+		mark = now;
+	};
+	auto loaded = [&]() { phase("Dictionary load"); };
+	double boardMs = 0, outputMs = 0;
+	BoardSource source = boards;
+	ResultSink sink = printResult;
+	if(stats)
+	{
+		source = [&](Board& board)
+		{
+			Clock::time_point start = Clock::now();
+			bool more = boards(board);
+			boardMs += ms(Clock::now() - start);
+			return more;
+		};
+		sink = [&](const Board& board, const set<string>& found)
+		{
+			Clock::time_point start = Clock::now();
+			printResult(board, found);
+			cout.flush();
+			outputMs += ms(Clock::now() - start);
+		};
+	}
+	resetSearchStats();
+	try
+	{
+		if(engine == "set")
+		{
+			pair<set<string>, set<string> > parsed = parseDict(string(argv[3]));
+			loaded();
+			boggleBatch(parsed.first, parsed.second, source, sink, threads);
+		}
+		else if(engine == "hash")
+		{
+			pair<HashDict, HashDict> parsed = parseDict<HashDict>(string(argv[3]));
+			loaded();
+			boggleBatch([&](const Board& board){
+				return boggle(parsed.first, parsed.second, board, threads);
+			}, source, sink);
+		}
+		else if(engine == "chash")
+		{
+			pair<ConcurrentHashDict, ConcurrentHashDict> parsed = parseDict<ConcurrentHashDict>(string(argv[3]));
+			loaded();
+			boggleBatch([&](const Board& board){
+				return boggle(parsed.first, parsed.second, board, threads);
+			}, source, sink);
+		}
+		else if(engine == "trie")
+		{
+			Trie dictionary = parseDictTrie(string(argv[3]));
+			loaded();
+			boggleBatch(dictionary, source, sink, threads);
+		}
+		else if(engine == "lines")
+		{
+			Trie dictionary = parseDictTrie(string(argv[3]));
+			loaded();
+			boggleBatch([&](const Board& board){
+				return boggleLines(dictionary, board, threads);
+			}, source, sink);
+		}
+		else if(engine == "aho")
+		{
+			Trie dictionary = parseDictTrie(string(argv[3]));
+			loaded();
+			AhoCorasick automaton(dictionary);
+			phase("Automaton build");
+			boggleBatch([&](const Board& board){
+				return boggle(automaton, board, threads);
+			}, source, sink);
+		}
+		else
+		{
+			cout << "Unknown engine: " << engine << endl;
+			exit(1);
+		}
+	}
+	catch(exception& e)
+	{
+		cout << "Error: " << e.what() << endl;
+		return 1;
+	}
+	if(stats)
+	{
+		double batchMs = ms(Clock::now() - mark);
+		cerr << (boardFile.empty() ? "Board generation: " : "Board input: ") << boardMs << " ms" << endl;
+		cerr << "Search: " << batchMs - boardMs - outputMs << " ms" << endl;
+		cerr << "Output: " << outputMs << " ms" << endl;
+		cerr << "Peak RSS: " << peakRSS() << " KB" << endl;
+#ifdef BOGGLE_STATS
+		SearchStats counts = searchStats();
+		cerr << "Steps: " << counts.steps << ", lookups: " << counts.lookups
+			<< ", hits: " << counts.hits << endl;
+#else
+		cerr << "(build with -DBOGGLE_STATS for step and lookup counts)" << endl;
+#endif
+	}
+	return 0;
 }
@@ -0,0 +1,189 @@
+//
+// End-to-end solver benchmark
+//
+// Loads the dictionary for each engine in turn, solves the same boards
+// (fixed seeds, every size) with it, and prints one row per engine and
+// board size:
+//   load_ms   dictionary load, plus the automaton build for aho
+//   gen_ms    board generation
+//   solve_ms  search
+//   words     words found, summed over the seeds
+//   steps, lookups, hits   search counts (see SearchStats in boggle.h)
+//   rss_kb    peak resident set size of the process so far
+// Every engine's words are checked against those of the first engine; any
+// difference is reported and makes the exit status 1.
+//
+// The default sweep takes a few minutes, most of it the set engine on the
+// 4096 board; --engines and --sizes narrow it down.
+//
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <set>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <cstring>
+#include <chrono>
+
+#include "boggle.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static double ms(Clock::duration d)
+{
+	return chrono::duration<double, milli>(d).count();
+}
+
+static vector<string> split(const string& list)
+{
+	vector<string> out;
+	stringstream ss(list);
+	string item;
+	while(getline(ss, item, ','))
+		if(!item.empty())
+			out.push_back(item);
+	return out;
+}
+
+// Load the dictionary for an engine and return its solver; the solver owns
+// the dictionary, so dropping it frees the memory before the next engine.
+static BoardSolver loadEngine(const string& engine, const string& dictFile, unsigned threads)
+{
+	if(engine == "set")
+	{
+		auto d = make_shared<pair<set<string>, set<string> > >(parseDict(dictFile));
+		return [d, threads](const Board& board){ return boggle(d->first, d->second, board, threads); };
+	}
+	if(engine == "hash")
+	{
+		auto d = make_shared<pair<HashDict, HashDict> >(parseDict<HashDict>(dictFile));
+		return [d, threads](const Board& board){ return boggle(d->first, d->second, board, threads); };
+	}
+	if(engine == "chash")
+	{
+		auto d = make_shared<pair<ConcurrentHashDict, ConcurrentHashDict> >(parseDict<ConcurrentHashDict>(dictFile));
+		return [d, threads](const Board& board){ return boggle(d->first, d->second, board, threads); };
+	}
+	shared_ptr<Trie> t = make_shared<Trie>(parseDictTrie(dictFile));
+	if(engine == "trie")
+		return [t, threads](const Board& board){ return boggle(*t, board, threads); };
+	if(engine == "lines")
+		return [t, threads](const Board& board){ return boggleLines(*t, board, threads); };
+	if(engine == "aho")
+	{
+		shared_ptr<AhoCorasick> a = make_shared<AhoCorasick>(*t);
+		return [t, a, threads](const Board& board){ return boggle(*a, board, threads); };
+	}
+	throw invalid_argument("unknown engine: " + engine);
+}
+
+int main(int argc, char* argv[])
+{
+	if(argc < 2)
+	{
+		cout << "Usage: boggle-perf <dictionary file> [--engines=set,hash,chash,trie,lines,aho]" << endl;
+		cout << "                   [--sizes=4,16,64,256,1024,4096] [--seed=S] [--seeds=N] [--threads=N]" << endl;
+		exit(1);
+	}
+	string dictFile = argv[1];
+	vector<string> engines = split("set,hash,chash,trie,lines,aho");
+	// a compiled dictionary can only be used by the trie engines
+	if(Trie::isCompiled(dictFile))
+		engines = split("trie,lines,aho");
+	vector<string> sizeList = split("4,16,64,256,1024,4096");
+	int firstSeed = 1;
+	int seeds = 1;
+	unsigned threads = 1;
+	for(int i = 2; i < argc; i++)
+	{
+		if(strncmp(argv[i], "--engines=", 10) == 0)
+			engines = split(argv[i] + 10);
+		else if(strncmp(argv[i], "--sizes=", 8) == 0)
+			sizeList = split(argv[i] + 8);
+		else if(strncmp(argv[i], "--seed=", 7) == 0)
+			firstSeed = atoi(argv[i] + 7);
+		else if(strncmp(argv[i], "--seeds=", 8) == 0)
+			seeds = atoi(argv[i] + 8);
+		else if(strncmp(argv[i], "--threads=", 10) == 0)
+			threads = atoi(argv[i] + 10);
+		else
+		{
+			cout << "Unknown option: " << argv[i] << endl;
+			exit(1);
+		}
+	}
+	vector<unsigned> sizes;
+	for(const string& s : sizeList)
+		sizes.push_back(atoi(s.c_str()));
+#ifndef BOGGLE_STATS
+	cerr << "(built without -DBOGGLE_STATS: steps, lookups and hits are 0)" << endl;
+#endif
+
+	cout << left << setw(8) << "engine" << right
+		<< setw(6) << "size" << setw(7) << "boards"
+		<< setw(10) << "load_ms" << setw(10) << "gen_ms" << setw(11) << "solve_ms"
+		<< setw(9) << "words" << setw(13) << "steps" << setw(13) << "lookups"
+		<< setw(13) << "hits" << setw(10) << "rss_kb" << endl;
+	cout << fixed << setprecision(1);
+
+	// words found by the first engine, by size and seed
+	map<pair<unsigned, int>, set<string> > reference;
+	bool agree = true;
+	Board board;
+	try
+	{
+		for(size_t e = 0; e < engines.size(); e++)
+		{
+			Clock::time_point start = Clock::now();
+			BoardSolver solve = loadEngine(engines[e], dictFile, threads);
+			double loadMs = ms(Clock::now() - start);
+
+			for(unsigned n : sizes)
+			{
+				double genMs = 0, solveMs = 0;
+				size_t words = 0;
+				resetSearchStats();
+				for(int seed = firstSeed; seed < firstSeed + seeds; seed++)
+				{
+					start = Clock::now();
+					genBoard(n, seed, board);
+					genMs += ms(Clock::now() - start);
+
+					start = Clock::now();
+					set<string> found = solve(board);
+					solveMs += ms(Clock::now() - start);
+					words += found.size();
+
+					pair<unsigned, int> key(n, seed);
+					if(e == 0)
+						reference[key].swap(found);
+					else if(found != reference[key])
+					{
+						agree = false;
+						cerr << "MISMATCH: " << engines[e] << " on size " << n << ", seed " << seed
+							<< " found " << found.size() << " words, " << engines[0]
+							<< " found " << reference[key].size() << endl;
+					}
+				}
+				SearchStats counts = searchStats();
+				cout << left << setw(8) << engines[e] << right
+					<< setw(6) << n << setw(7) << seeds
+					<< setw(10) << loadMs << setw(10) << genMs << setw(11) << solveMs
+					<< setw(9) << words << setw(13) << counts.steps << setw(13) << counts.lookups
+					<< setw(13) << counts.hits << setw(10) << peakRSS() << endl;
+			}
+		}
+	}
+	catch(exception& e)
+	{
+		cout << "Error: " << e.what() << endl;
+		return 1;
+	}
+	if(engines.size() > 1)
+		cout << (agree ? "All engines agree" : "Engines DISAGREE") << endl;
+	return agree ? 0 : 1;
+}
@@ -7,104 +7,540 @@
 #include <iomanip>
 #include <fstream>
 #include <exception>
+#include <utility>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <sys/resource.h>
 #endif
 
 #include "boggle.h"
 
-std::vector<std::vector<char> > genBoard(unsigned int n, int seed)
+Board genBoard(unsigned int n, int seed)
+{
+    Board board;
+    genBoard(n, seed, board);
+    return board;
+}
+
+void genBoard(unsigned int n, int seed, Board& board)
 {
     // random number generator
     std::mt19937 r(seed);
 
     // scrabble letter frequencies
-    int freq[26] = {9,2,2,4,12,2,3,2,9,1,1,4,2,6,8,2,1,6,4,6,4,2,2,1,2,1};
-    std::vector<char> letters;
-    for(char c='A'; c<='Z'; c++)
-        for(int i=0; i<freq[c-'A']; i++)
-            letters.push_back(c);
+    static const int freq[26] = {9,2,2,4,12,2,3,2,9,1,1,4,2,6,8,2,1,6,4,6,4,2,2,1,2,1};
+    static const std::vector<char> letters = []{
+        std::vector<char> l;
+        for(char c='A'; c<='Z'; c++)
+            for(int i=0; i<freq[c-'A']; i++)
+                l.push_back(c);
+        return l;
+    }();
 
-    std::vector<std::vector<char>> board(n, std::vector<char>(n));
+    board.resize(n);
     for(unsigned i=0; i<n; i++)
         for(unsigned j=0; j<n; j++)
-            board[i][j] = letters[r() % letters.size()];
-
-    return board;
+            board(i, j) = letters[r() % letters.size()];
 }
 
-void printBoard(const std::vector<std::vector<char>>& board)
+void printBoard(const Board& board, std::ostream& out)
 {
     unsigned n = board.size();
     for(unsigned i=0; i<n; i++){
         for(unsigned j=0; j<n; j++)
-            std::cout << std::setw(2) << board[i][j];
-        std::cout << "\n";
+            out << std::setw(2) << board(i, j);
+        out << "\n";
     }
 }
 
-std::pair<std::set<std::string>, std::set<std::string>> parseDict(std::string fname)
+// letters of line, upper-cased, with the spaces dropped; every engine
+// matches A-Z only, so anything else is an error rather than a cell that
+// some engines would skip and others would compare as is
+static void readRow(const std::string& line, std::vector<char>& row)
+{
+    row.clear();
+    for(char c : line){
+        if(isspace(static_cast<unsigned char>(c)))
+            continue;
+        if(c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        if(c < 'A' || c > 'Z')
+            throw std::invalid_argument("board cell is not a letter");
+        row.push_back(c);
+    }
+}
+
+bool readBoard(std::istream& in, Board& board)
+{
+    std::string line;
+    std::vector<char> row;
+    // the first non-blank line gives the board size
+    do {
+        if(!std::getline(in, line))
+            return false;
+        readRow(line, row);
+    } while(row.empty());
+
+    unsigned n = row.size();
+    board.resize(n);
+    for(unsigned i = 0; ; ){
+        std::copy(row.begin(), row.end(), board.row(i));
+        if(++i == n)
+            break;
+        if(!std::getline(in, line))
+            throw std::invalid_argument("board ends early");
+        readRow(line, row);
+        if(row.size() != n)
+            throw std::invalid_argument("board is not square");
+    }
+    return true;
+}
+
+// isspace in the "C" locale, which is what >> uses for dict.txt
+static inline bool isBlank(char c)
 {
-    std::ifstream dictfs(fname);
+    return c == ' ' || static_cast<unsigned char>(c - '\t') < 5;
+}
+
+// Read all of fname with a single read and split it on whitespace, as >>
+// would. The words point into buf and are in file order.
+static void loadWords(const std::string& fname, std::string& buf, std::vector<TrieWord>& words)
+{
+    std::ifstream dictfs(fname, std::ios::binary);
     if(dictfs.fail())
         throw std::invalid_argument("unable to open dictionary file");
+    dictfs.seekg(0, std::ios::end);
+    std::streamoff size = dictfs.tellg();
+    if(size >= 0){
+        dictfs.seekg(0, std::ios::beg);
+        buf.resize(size);
+        dictfs.read(&buf[0], size);
+    }
+    else{
+        // not seekable (a pipe); read it as a stream instead
+        dictfs.clear();
+        buf.assign(std::istreambuf_iterator<char>(dictfs), std::istreambuf_iterator<char>());
+    }
 
-    std::set<std::string> dict, prefix;
-    std::string word;
-    while(dictfs >> word){
-        dict.insert(word);
-        // all proper prefixes of word
-        for(size_t i = word.size(); i > 1; --i)
-            prefix.insert(word.substr(0, i-1));
+    words.clear();
+    words.reserve(buf.size() / 8);
+    const char* p = buf.data();
+    const char* end = p + buf.size();
+    while(p != end){
+        while(p != end && isBlank(*p))
+            ++p;
+        const char* start = p;
+        while(p != end && !isBlank(*p))
+            ++p;
+        if(p != start)
+            words.push_back(TrieWord{start, static_cast<size_t>(p - start)});
     }
-    prefix.insert("");  // allow empty prefix
-    return {dict, prefix};
+}
+
+DictWords::DictWords(const std::string& fname)
+{
+    loadWords(fname, buf_, words_);
+    // sorting only moves pointers
+    sortWords(words_);
+}
+
+std::pair<std::set<std::string>, std::set<std::string>> parseDict(std::string fname)
+{
+    return parseDict<std::set<std::string> >(fname);
+}
+
+Trie parseDictTrie(std::string fname)
+{
+    // a file written by dict-compile is mapped and used as is
+    if(Trie::isCompiled(fname))
+        return Trie::load(fname);
+
+    // the trie is built straight from the file buffer, upper-cased in place
+    std::string buf;
+    std::vector<TrieWord> words;
+    loadWords(fname, buf, words);
+    for(char& c : buf)
+        if(c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+    return Trie(std::move(words));
 }
 
 std::set<std::string> boggle(
     const std::set<std::string>& dict,
     const std::set<std::string>& prefix,
-    const std::vector<std::vector<char>>& board)
+    const Board& board,
+    unsigned threads)
 {
-    std::set<std::string> result;
-    unsigned n = board.size();
-    for(unsigned i=0; i<n; i++){
-        for(unsigned j=0; j<n; j++){
-            boggleHelper(dict, prefix, board, "", result, i, j, 0, 1);
-            boggleHelper(dict, prefix, board, "", result, i, j, 1, 0);
-            boggleHelper(dict, prefix, board, "", result, i, j, 1, 1);
+    return boggle<std::set<std::string> >(dict, prefix, board, threads);
+}
+
+#ifdef BOGGLE_STATS
+thread_local SearchStats threadSearchStats;
+static SearchStats totalSearchStats;
+static std::mutex searchStatsMutex;
+
+void flushSearchStats()
+{
+    std::lock_guard<std::mutex> lock(searchStatsMutex);
+    totalSearchStats.steps += threadSearchStats.steps;
+    totalSearchStats.lookups += threadSearchStats.lookups;
+    totalSearchStats.hits += threadSearchStats.hits;
+    threadSearchStats = SearchStats();
+}
+
+SearchStats searchStats()
+{
+    flushSearchStats();
+    std::lock_guard<std::mutex> lock(searchStatsMutex);
+    return totalSearchStats;
+}
+
+void resetSearchStats()
+{
+    std::lock_guard<std::mutex> lock(searchStatsMutex);
+    totalSearchStats = threadSearchStats = SearchStats();
+}
+#else
+SearchStats searchStats() { return SearchStats(); }
+void resetSearchStats() {}
+#endif
+
+size_t peakRSS()
+{
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    // Linux reports kilobytes
+    return static_cast<size_t>(usage.ru_maxrss);
+}
+
+// w in d, given the rolling hash of w: the table's hash and its
+// DoubleHashProber's step hash both come from the one rolling state
+static bool hashDictHas(const HashDict& d, const RollingStringHash& roll, const std::string& w)
+{
+    return d.findByHash(roll.value(d.hasher()), roll.value(d.prober().h2_), w) != nullptr;
+}
+
+void dictWalk(
+    const HashDict& dict,
+    const HashDict& prefix,
+    const Board& board,
+    std::string& word,
+    std::set<std::string>& result,
+    unsigned r, unsigned c,
+    int dr, int dc)
+{
+    RollingStringHash roll;
+    size_t best = 0;
+    word.clear();
+    ptrdiff_t step = board.step(dr, dc);
+    for(const char* p = &board(r, c); *p; p += step){
+        word.push_back(*p);
+        roll.push_back(*p);
+        BOGGLE_STATS_ONLY(threadSearchStats.steps++;)
+        BOGGLE_STATS_ONLY(threadSearchStats.lookups += 2;)
+        if(hashDictHas(dict, roll, word)){
+            BOGGLE_STATS_ONLY(threadSearchStats.hits++;)
+            best = word.size();
         }
+        if(!hashDictHas(prefix, roll, word))
+            break;
+        BOGGLE_STATS_ONLY(threadSearchStats.hits++;)
+    }
+    if(best){
+        word.resize(best);
+        result.insert(word);
     }
-    return result;
 }
 
 // Returns true if this call inserted a word (so parent knows not to insert its shorter prefix)
 bool boggleHelper(
     const std::set<std::string>& dict,
     const std::set<std::string>& prefix,
-    const std::vector<std::vector<char>>& board,
+    const Board& board,
     std::string word,
     std::set<std::string>& result,
     unsigned r, unsigned c,
     int dr, int dc)
 {
+    BOGGLE_STATS_ONLY(threadSearchStats.steps++;)
     unsigned n = board.size();
     // out of bounds?
-    if(r >= n || c >= n) 
+    if(r >= n || c >= n)
         return false;
 
     // extend current string
-    word.push_back(board[r][c]);
+    word.push_back(board(r, c));
 
     bool foundLonger = false;
     // if we can still build a longer word, recurse
+    BOGGLE_STATS_ONLY(threadSearchStats.lookups++;)
     if(prefix.find(word) != prefix.end()){
+        BOGGLE_STATS_ONLY(threadSearchStats.hits++;)
         foundLonger = boggleHelper(dict, prefix, board, word, result, r + dr, c + dc, dr, dc);
     }
 
     // if no longer word was found down this path, and 'word' is in dict, insert it
-    if(!foundLonger && dict.find(word) != dict.end()){
+    if(!foundLonger){
+        BOGGLE_STATS_ONLY(threadSearchStats.lookups++;)
+        if(dict.find(word) != dict.end()){
+            BOGGLE_STATS_ONLY(threadSearchStats.hits++;)
+            result.insert(word);
+            return true;
+        }
+    }
+
+    return foundLonger;
+}
+
+// Walk from (r, c) in direction (dr, dc) and insert the longest word found.
+// This is boggleHelper unrolled: the recursion only continues while the
+// current string is a proper prefix (the trie node has children), and only
+// the deepest word it reaches is inserted.
+static void trieWalk(
+    const Trie& dict,
+    const Board& board,
+    std::set<std::string>& result,
+    unsigned r, unsigned c,
+    int dr, int dc)
+{
+    Trie::NodeIndex node = dict.root();
+    unsigned len = 0, best = 0;
+    ptrdiff_t step = board.step(dr, dc);
+    // the '\0' border has no trie child, so it ends the walk
+    for(const char* p = &board(r, c); ; p += step){
+        BOGGLE_STATS_ONLY(threadSearchStats.steps++;)
+        BOGGLE_STATS_ONLY(threadSearchStats.lookups++;)
+        node = dict.child(node, *p);
+        if(node == Trie::npos)
+            break;
+        BOGGLE_STATS_ONLY(threadSearchStats.hits++;)
+        ++len;
+        if(dict.isWord(node))
+            best = len;
+        if(!dict.hasChildren(node))
+            break;
+    }
+    if(best){
+        const char* start = &board(r, c);
+        std::string word(best, ' ');
+        for(unsigned k = 0; k < best; ++k)
+            word[k] = start[k*step];
         result.insert(word);
+    }
+}
+
+std::set<std::string> boggle(
+    const Trie& dict,
+    const Board& board,
+    unsigned threads)
+{
+    return solveRows(board.size(), threads,
+        [&](unsigned i, std::set<std::string>& result, std::string&){
+            for(unsigned j=0; j<board.size(); j++){
+                trieWalk(dict, board, result, i, j, 0, 1);
+                trieWalk(dict, board, result, i, j, 1, 0);
+                trieWalk(dict, board, result, i, j, 1, 1);
+            }
+        });
+}
+
+BoardSource seedBoards(unsigned int n, int firstSeed, size_t count)
+{
+    size_t done = 0;
+    return [=](Board& board) mutable {
+        if(done == count)
+            return false;
+        genBoard(n, firstSeed + static_cast<int>(done++), board);
         return true;
+    };
+}
+
+BoardSource streamBoards(std::istream& in)
+{
+    return [&in](Board& board) {
+        return readBoard(in, board);
+    };
+}
+
+// Which starts can lead anywhere, from the first two letters alone: bit b of
+// follow[a] is set if the trie has a node for letters a then b, and bit a of
+// words is set if a is a one-letter word. Letters outside A-Z never match.
+struct StartFilter {
+    uint32_t follow[26];
+    uint32_t words;
+
+    explicit StartFilter(const Trie& dict) : words(0)
+    {
+        for(unsigned a = 0; a < 26; a++){
+            follow[a] = 0;
+            Trie::NodeIndex first = dict.child(dict.root(), 'A' + a);
+            if(first == Trie::npos)
+                continue;
+            if(dict.isWord(first))
+                words |= 1u << a;
+            for(unsigned b = 0; b < 26; b++)
+                if(dict.child(first, 'A' + b) != Trie::npos)
+                    follow[a] |= 1u << b;
+        }
     }
 
-    return foundLonger;
+    static unsigned letter(char c) { return static_cast<unsigned>((c | 0x20) - 'a'); }
+
+    // first can start a word; second is '\0' at the end of a line
+    bool viable(char first, char second) const
+    {
+        unsigned a = letter(first), b = letter(second);
+        if(a >= 26)
+            return false;
+        return ((words >> a) & 1) || (b < 26 && ((follow[a] >> b) & 1));
+    }
+};
+
+// Copy line k of the board into buf: rows are 0..n-1, columns n..2n-1, and
+// down-right diagonals 2n..4n-2, starting along the top row and then down
+// the left column.
+static void extractLine(const Board& board, unsigned k, std::string& buf)
+{
+    unsigned n = board.size();
+    buf.clear();
+    const char* p;
+    ptrdiff_t step;
+    if(k < n){
+        p = board.row(k);
+        step = 1;
+    }
+    else if(k < 2*n){
+        p = &board(0, k - n);
+        step = board.step(1, 0);
+    }
+    else{
+        unsigned d = k - 2*n;
+        p = d < n ? &board(0, d) : &board(d - n + 1, 0);
+        step = board.step(1, 1);
+    }
+    for(; *p; p += step)
+        buf.push_back(*p);
+}
+
+// trieWalk over a contiguous line: insert the longest word from each start
+static void lineWalk(
+    const Trie& dict,
+    const StartFilter& filter,
+    const std::string& line,
+    std::set<std::string>& result)
+{
+    size_t len = line.size();
+    const char* s = line.data();
+    for(size_t i = 0; i < len; i++){
+        if(!filter.viable(s[i], s[i+1]))
+            continue;
+        Trie::NodeIndex node = dict.root();
+        size_t best = 0;
+        for(size_t j = i; j < len; j++){
+            BOGGLE_STATS_ONLY(threadSearchStats.steps++;)
+            BOGGLE_STATS_ONLY(threadSearchStats.lookups++;)
+            node = dict.child(node, s[j]);
+            if(node == Trie::npos)
+                break;
+            BOGGLE_STATS_ONLY(threadSearchStats.hits++;)
+            if(dict.isWord(node))
+                best = j - i + 1;
+            if(!dict.hasChildren(node))
+                break;
+        }
+        if(best)
+            result.insert(std::string(s + i, best));
+    }
+}
+
+std::set<std::string> boggleLines(
+    const Trie& dict,
+    const Board& board,
+    unsigned threads)
+{
+    unsigned n = board.size();
+    if(n == 0)
+        return std::set<std::string>();
+    StartFilter filter(dict);
+    return solveRows(4*n - 1, threads,
+        [&](unsigned k, std::set<std::string>& result, std::string& line){
+            extractLine(board, k, line);
+            lineWalk(dict, filter, line, result);
+        });
+}
+
+std::set<std::string> boggle(
+    const AhoCorasick& dict,
+    const Board& board,
+    unsigned threads)
+{
+    unsigned n = board.size();
+    if(n == 0)
+        return std::set<std::string>();
+    return solveRows(4*n - 1, threads,
+        [&](unsigned k, std::set<std::string>& result, std::string& line){
+            extractLine(board, k, line);
+            // length of the longest word starting at each position; for a
+            // given start a later match is always longer, so the last one
+            // reported wins
+            static thread_local std::vector<unsigned> best;
+            best.assign(line.size(), 0);
+            BOGGLE_STATS_ONLY(threadSearchStats.steps += line.size();)
+            BOGGLE_STATS_ONLY(threadSearchStats.lookups += line.size();)
+            dict.scan(line.data(), line.size(), [&](size_t end, unsigned len){
+                BOGGLE_STATS_ONLY(threadSearchStats.hits++;)
+                best[end + 1 - len] = len;
+            });
+            for(size_t i = 0; i < line.size(); i++)
+                if(best[i])
+                    result.insert(line.substr(i, best[i]));
+        });
+}
+
+template <typename Solve>
+static size_t runBatch(const BoardSource& next, const ResultSink& emit, Solve solve)
+{
+    Board board;
+    std::set<std::string> found;
+    size_t count = 0;
+    while(next(board)){
+        found = solve(board);
+        emit(board, found);
+        ++count;
+    }
+    return count;
+}
+
+size_t boggleBatch(const BoardSolver& solve, const BoardSource& next, const ResultSink& emit)
+{
+    return runBatch(next, emit, solve);
+}
+
+size_t boggleBatch(
+    const std::set<std::string>& dict,
+    const std::set<std::string>& prefix,
+    const BoardSource& next,
+    const ResultSink& emit,
+    unsigned threads)
+{
+    return runBatch(next, emit, [&](const Board& board){
+        return boggle(dict, prefix, board, threads);
+    });
+}
+
+size_t boggleBatch(
+    const Trie& dict,
+    const BoardSource& next,
+    const ResultSink& emit,
+    unsigned threads)
+{
+    return runBatch(next, emit, [&](const Board& board){
+        return boggle(dict, board, threads);
+    });
 }
@@ -6,11 +6,328 @@
 #include <set>
 #include <utility>
 #include <string>
+#include <iostream>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
 #endif
 
-std::vector<std::vector<char> > genBoard(unsigned int n, int seed);
-void printBoard(const std::vector<std::vector<char> >& board);
+#include "trie.h"
+#include "board.h"
+#include "aho-corasick.h"
+#include "ht.h"
+#include "concurrent-ht.h"
+#include "hash.h"
+
+// Boards are Board objects. Code written against std::vector<std::vector<char> >
+// converts with Board(rows) and back with an explicit cast; each copies the
+// board.
+Board genBoard(unsigned int n, int seed);
+// fill board in place, reusing its rows when the size is unchanged
+void genBoard(unsigned int n, int seed, Board& board);
+void printBoard(const Board& board, std::ostream& out = std::cout);
+// Read the next board in printBoard's format: n rows of n letters, spaces
+// ignored, with optional blank lines between boards. Letters are
+// upper-cased. Returns false at end of input and throws
+// std::invalid_argument on a malformed board or a cell outside A-Z.
+bool readBoard(std::istream& in, Board& board);
 std::pair<std::set<std::string>, std::set<std::string> > parseDict(std::string fname);
-std::set<std::string> boggle(const std::set<std::string>& dict, const std::set<std::string>& prefix, const std::vector<std::vector<char> >& board);
-bool boggleHelper(const std::set<std::string>& dict, const std::set<std::string>& prefix, const std::vector<std::vector<char> >& board, std::string word, std::set<std::string>& result, unsigned int r, unsigned int c, int dr, int dc);
-#endif
\ No newline at end of file
+// Both solvers take an optional thread count: rows of start cells are
+// handed out to that many workers on demand, each collects its own results,
+// and the sets are merged at the end. 0 means one thread per hardware core.
+std::set<std::string> boggle(const std::set<std::string>& dict, const std::set<std::string>& prefix, const Board& board, unsigned threads = 1);
+
+// ----- Dictionary containers -----
+// parseDict<Dict> and boggle<Dict> work with any container that dictInsert
+// and dictContains accept: by default anything with emplace_hint, find and
+// end (std::set, std::unordered_set), plus HashTable and ConcurrentHashTable.
+// Overload the two functions (and dictReserve, SizedFill and
+// ConcurrentLookups, if need be) to plug in another type.
+template <typename Dict>
+void dictInsert(Dict& d, const char* p, size_t len) { d.emplace_hint(d.end(), p, len); }
+template <typename Dict>
+bool dictContains(const Dict& d, const std::string& w) { return d.find(w) != d.end(); }
+template <typename Dict>
+void dictReserve(Dict&, size_t) {}
+
+template <typename K, typename V, typename P, typename H, typename E, typename A>
+void dictInsert(HashTable<K,V,P,H,E,A>& d, const char* p, size_t len)
+{
+    d.insert(typename HashTable<K,V,P,H,E,A>::ItemType(K(p, len), V()));
+}
+template <typename K, typename V, typename P, typename H, typename E, typename A>
+bool dictContains(const HashTable<K,V,P,H,E,A>& d, const std::string& w) { return d.find(w) != nullptr; }
+template <typename K, typename V, typename P, typename H, typename E, typename A>
+void dictReserve(HashTable<K,V,P,H,E,A>& d, size_t n) { d.reserve(n); }
+
+template <typename K, typename V, typename P, typename H, typename E>
+void dictInsert(ConcurrentHashTable<K,V,P,H,E>& d, const char* p, size_t len)
+{
+    d.insert(typename ConcurrentHashTable<K,V,P,H,E>::ItemType(K(p, len), V()));
+}
+template <typename K, typename V, typename P, typename H, typename E>
+bool dictContains(const ConcurrentHashTable<K,V,P,H,E>& d, const std::string& w) { return d.contains(w); }
+template <typename K, typename V, typename P, typename H, typename E>
+void dictReserve(ConcurrentHashTable<K,V,P,H,E>& d, size_t n) { d.reserve(n); }
+
+// Whether parseDict should count the prefixes first and dictReserve() that
+// many: worth a pass over the words only for containers that rehash as they
+// grow.
+template <typename Dict>
+struct SizedFill : std::false_type {};
+template <typename K, typename V, typename P, typename H, typename E, typename A>
+struct SizedFill<HashTable<K,V,P,H,E,A> > : std::true_type {};
+template <typename K, typename V, typename P, typename H, typename E>
+struct SizedFill<ConcurrentHashTable<K,V,P,H,E> > : std::true_type {};
+
+// Whether const lookups may run on several threads at once. HashTable's may
+// not (they update its prober and probe count), so boggle<> solves those on
+// one thread whatever it is asked for.
+template <typename Dict>
+struct ConcurrentLookups : std::true_type {};
+template <typename K, typename V, typename P, typename H, typename E, typename A>
+struct ConcurrentLookups<HashTable<K,V,P,H,E,A> > : std::false_type {};
+
+// the hash-backed dictionary boggle-driver offers as --engine=hash
+typedef HashTable<std::string, bool, DoubleHashProber<std::string, MyStringHash>, MyStringHash> HashDict;
+// and the one it offers as --engine=chash, whose lookups can run on every
+// thread. ConcurrentHashTable frees nothing its writers replace until
+// reclaim(), so its memory grows with every update (see concurrent-ht.h).
+// That costs nothing here: parseDict reserves first and inserts each word
+// once, so it retires only the initial 11-slot array, and the solvers only
+// read.
+typedef ConcurrentHashTable<std::string, bool, DoubleHashProber<std::string, MyStringHash>, MyStringHash> ConcurrentHashDict;
+
+// The walk boggle<HashDict> uses: rolling hashes carry each table's hash and
+// probe step along from one character to the next (see findByHash), so no
+// step hashes the word from scratch.
+void dictWalk(const HashDict& dict, const HashDict& prefix, const Board& board, std::string& word, std::set<std::string>& result, unsigned int r, unsigned int c, int dr, int dc);
+
+// The words of a dictionary file, sorted and deduplicated, pointing into a
+// single buffer that holds the whole file.
+class DictWords {
+public:
+    explicit DictWords(const std::string& fname);
+    const std::vector<TrieWord>& words() const { return words_; }
+
+    // Call f(p, len) for "" and then every proper prefix of the words, each
+    // once and in sorted order. The prefixes of a word that are new are
+    // exactly those longer than its common prefix with the previous word
+    // (plus the previous word itself, if it is a prefix of this one).
+    template <typename F>
+    void forEachPrefix(F f) const
+    {
+        f("", 0);
+        const TrieWord* prev = nullptr;
+        for(const TrieWord& w : words_){
+            size_t from = 1;
+            if(prev){
+                size_t lcp = 0, most = std::min(prev->len, w.len);
+                while(lcp < most && prev->p[lcp] == w.p[lcp])
+                    ++lcp;
+                from = std::max<size_t>(1, lcp == prev->len ? lcp : lcp + 1);
+            }
+            for(size_t len = from; len < w.len; ++len)
+                f(w.p, len);
+            prev = &w;
+        }
+    }
+
+private:
+    std::string buf_;
+    std::vector<TrieWord> words_;
+};
+
+// Words and proper prefixes (with "") of a dictionary file, in any container.
+template <typename Dict>
+std::pair<Dict, Dict> parseDict(std::string fname);
+// Nonempty strings { dict, prefix } must both contain; any Dict as above.
+template <typename Dict>
+std::set<std::string> boggle(const Dict& dict, const Dict& prefix, const Board& board, unsigned threads = 1);
+
+// The recursive reference search for one start and direction. boggle() now
+// uses an equivalent walk that reuses a single buffer instead.
+bool boggleHelper(const std::set<std::string>& dict, const std::set<std::string>& prefix, const Board& board, std::string word, std::set<std::string>& result, unsigned int r, unsigned int c, int dr, int dc);
+
+// Trie-backed solver: same results as the set version, but each step is one
+// child lookup and prefixes need no storage of their own. parseDictTrie
+// accepts a word list or a dictionary compiled by dict-compile.
+Trie parseDictTrie(std::string fname);
+std::set<std::string> boggle(const Trie& dict, const Board& board, unsigned threads = 1);
+// Same results again, but every row, column and diagonal is first copied
+// into a contiguous buffer and walked there, and starts whose first two
+// letters cannot begin a word are skipped without touching the trie.
+std::set<std::string> boggleLines(const Trie& dict, const Board& board, unsigned threads = 1);
+// Line scanning with an automaton: one pass per row, column and diagonal
+// finds every word on it, keeping the longest word from each start.
+std::set<std::string> boggle(const AhoCorasick& dict, const Board& board, unsigned threads = 1);
+
+// Batch solving: the dictionary is loaded once by the caller, then next()
+// fills in each board in turn (returning false when there are no more) and
+// emit() receives it with its words. The board is the same object every
+// time, so its storage is reused. Returns the number of boards solved.
+typedef std::function<bool(Board&)> BoardSource;
+typedef std::function<void(const Board&, const std::set<std::string>&)> ResultSink;
+typedef std::function<std::set<std::string>(const Board&)> BoardSolver;
+size_t boggleBatch(const BoardSolver& solve, const BoardSource& next, const ResultSink& emit);
+size_t boggleBatch(const std::set<std::string>& dict, const std::set<std::string>& prefix, const BoardSource& next, const ResultSink& emit, unsigned threads = 1);
+size_t boggleBatch(const Trie& dict, const BoardSource& next, const ResultSink& emit, unsigned threads = 1);
+
+// sources for boggleBatch: count boards of size n from consecutive seeds,
+// or boards read with readBoard until in is exhausted
+BoardSource seedBoards(unsigned int n, int firstSeed, size_t count);
+BoardSource streamBoards(std::istream& in);
+
+// ----- Search statistics -----
+// Compile with -DBOGGLE_STATS to have the solvers count their work. steps
+// are boggleHelper calls and walk or scan steps (one per letter examined),
+// lookups are dictionary, prefix and trie-child queries, and hits are the
+// lookups that found something. For the automaton every letter fed in is a
+// lookup and every match reported a hit. Each thread counts on its own, and
+// solveRows adds a worker's counts to the totals when it finishes. Without
+// BOGGLE_STATS the counts stay zero and the solvers do no extra work.
+struct SearchStats {
+    size_t steps;
+    size_t lookups;
+    size_t hits;
+};
+// totals so far, including the calling thread's own counts
+SearchStats searchStats();
+void resetSearchStats();
+// peak resident set size of this process so far, in kilobytes
+size_t peakRSS();
+
+#ifdef BOGGLE_STATS
+#define BOGGLE_STATS_ONLY(x) x
+extern thread_local SearchStats threadSearchStats;
+// add this thread's counts to the totals and zero them
+void flushSearchStats();
+#else
+#define BOGGLE_STATS_ONLY(x)
+#endif
+
+// ----- Template definitions -----
+
+template <typename Dict>
+std::pair<Dict, Dict> parseDict(std::string fname)
+{
+    DictWords words(fname);
+    std::pair<Dict, Dict> d;
+    // Both containers are filled in sorted order, which lets std::set put
+    // every insert at the end hint in constant time. They are independent,
+    // so with more than one core the prefixes go in on a second thread.
+    auto fillDict = [&]{
+        dictReserve(d.first, words.words().size());
+        for(const TrieWord& w : words.words())
+            dictInsert(d.first, w.p, w.len);
+    };
+    auto fillPrefix = [&]{
+        if(SizedFill<Dict>::value){
+            size_t count = 0;
+            words.forEachPrefix([&](const char*, size_t){ ++count; });
+            dictReserve(d.second, count);
+        }
+        words.forEachPrefix([&](const char* p, size_t len){ dictInsert(d.second, p, len); });
+    };
+    if(std::thread::hardware_concurrency() > 1){
+        std::thread dictThread(fillDict);
+        fillPrefix();
+        dictThread.join();
+    }
+    else{
+        fillDict();
+        fillPrefix();
+    }
+    return d;
+}
+
+// Run walkRow(row, result, buffer) for rows 0..n-1, where a row is any unit
+// of independent work (a board row, or one line for boggleLines and the
+// automaton) and the buffer is the worker's scratch string, kept from one
+// row to the next so it only allocates while it grows. Workers claim the
+// next unsolved row from a shared counter, so a slow row never holds up the
+// others, and write only to their own result set and buffer; the per-worker
+// sets are merged once all rows are done. With one thread everything runs
+// on the caller's thread.
+template <typename WalkRow>
+std::set<std::string> solveRows(unsigned n, unsigned threads, WalkRow walkRow)
+{
+    if(threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max(1u, std::min(threads, n));
+
+    std::vector<std::set<std::string> > results(threads);
+    std::atomic<unsigned> nextRow(0);
+    auto worker = [&](unsigned t){
+        std::string buffer;
+        for(unsigned i; (i = nextRow.fetch_add(1, std::memory_order_relaxed)) < n; )
+            walkRow(i, results[t], buffer);
+        BOGGLE_STATS_ONLY(flushSearchStats();)
+    };
+
+    std::vector<std::thread> pool;
+    for(unsigned t = 1; t < threads; t++)
+        pool.emplace_back(worker, t);
+    worker(0);
+    for(std::thread& th : pool)
+        th.join();
+
+    for(unsigned t = 1; t < threads; t++)
+        results[0].insert(results[t].begin(), results[t].end());
+    return std::move(results[0]);
+}
+
+// boggleHelper without the recursion or the per-step string copies: word is
+// a caller-owned buffer that is overwritten in place, so a walk allocates
+// only when it inserts a result. Like boggleHelper, it extends while the
+// string is a prefix and inserts the deepest dictionary word it reached.
+template <typename Dict>
+void dictWalk(
+    const Dict& dict,
+    const Dict& prefix,
+    const Board& board,
+    std::string& word,
+    std::set<std::string>& result,
+    unsigned r, unsigned c,
+    int dr, int dc)
+{
+    size_t best = 0;
+    word.clear();
+    ptrdiff_t step = board.step(dr, dc);
+    for(const char* p = &board(r, c); *p; p += step){
+        word.push_back(*p);
+        BOGGLE_STATS_ONLY(threadSearchStats.steps++;)
+        BOGGLE_STATS_ONLY(threadSearchStats.lookups += 2;)
+        if(dictContains(dict, word)){
+            BOGGLE_STATS_ONLY(threadSearchStats.hits++;)
+            best = word.size();
+        }
+        if(!dictContains(prefix, word))
+            break;
+        BOGGLE_STATS_ONLY(threadSearchStats.hits++;)
+    }
+    if(best){
+        word.resize(best);
+        result.insert(word);
+    }
+}
+
+template <typename Dict>
+std::set<std::string> boggle(const Dict& dict, const Dict& prefix, const Board& board, unsigned threads)
+{
+    if(!ConcurrentLookups<Dict>::value)
+        threads = 1;
+    // each worker has one buffer for all of its walks; it never grows past
+    // n characters
+    return solveRows(board.size(), threads,
+        [&](unsigned i, std::set<std::string>& result, std::string& word){
+            for(unsigned j=0; j<board.size(); j++){
+                dictWalk(dict, prefix, board, word, result, i, j, 0, 1);
+                dictWalk(dict, prefix, board, word, result, i, j, 1, 0);
+                dictWalk(dict, prefix, board, word, result, i, j, 1, 1);
+            }
+        });
+}
+#endif
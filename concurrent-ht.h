@@ -0,0 +1,385 @@
+#ifndef CONCURRENT_HT_H
+#define CONCURRENT_HT_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdexcept>
+#include <utility>
+#include <functional>
+
+#include "ht.h"
+
+// ------------------------ ConcurrentHashTable ------------------------------
+//
+// A HashTable for many readers and a few writers. Lookups take no lock and
+// write nothing shared: each copies the prober and runs it on its own, and
+// finishes within one pass over the table, so they are wait-free.
+//
+// Slots hold pointers to immutable nodes. A writer locks the stripe its
+// key's hash maps to; writers with different stripes run at the same time
+// and claim empty slots by compare-and-swap. Changing a value replaces the
+// node, and a removal replaces it with a tombstone, so a reader always sees
+// a whole item, old or new. A resize locks every stripe, builds the new
+// slot array from the same nodes and publishes it with one pointer store;
+// readers on the old array carry on undisturbed, seeing the table as it was
+// when the resize started.
+//
+// Replaced nodes and old slot arrays are retired, not freed: the pointers
+// find() returns stay valid until reclaim() (or the destructor), which must
+// only be called when no lookup is in progress. There is no reader tracking
+// to free them any sooner, since lookups write nothing shared, so retired
+// memory grows without bound: every replace and remove keeps a node and
+// every resize keeps the old slot array. A table that is updated for as
+// long as it is read needs reclaim() at regular quiescent points. The table
+// can be moved but not copied.
+//
+// With HT_STATS the tables count probes in a relaxed atomic; that counter is
+// shared by every reader, so leave HT_STATS off when measuring scaling.
+
+template<
+    typename K,
+    typename V,
+    typename ProberType = LinearProber<K>,
+    typename Hash       = std::hash<K>,
+    typename KeyEqual   = std::equal_to<K>
+>
+class ConcurrentHashTable {
+    static_assert(ProberType::groupWidth == 1,
+                  "group probing needs the control bytes of FlatHashTable");
+    static_assert(!ProberType::robinHood, "Robin Hood order is only kept by HashTable");
+public:
+    using KeyType   = K;
+    using ValueType = V;
+    using ItemType  = std::pair<KeyType,ValueType>;
+    using Hasher    = Hash;
+
+    static const size_t DEFAULT_STRIPES = 64;
+
+    // stripes is rounded up to a power of two
+    ConcurrentHashTable(double alpha = 0.4,
+                        const ProberType& prober = ProberType(),
+                        const Hasher& hash     = Hasher(),
+                        const KeyEqual& eq     = KeyEqual(),
+                        size_t stripes         = DEFAULT_STRIPES)
+      : prober_(prober)
+      , hash_(hash)
+      , eq_(eq)
+      , alpha_(alpha)
+      , stripeCount_(1)
+      , count_(0)
+      , used_(0)
+#ifdef HT_STATS
+      , totalProbes_(0)
+#endif
+    {
+        while (stripeCount_ < stripes) stripeCount_ <<= 1;
+        stripes_.reset(new Stripe[stripeCount_]);
+        table_.store(new Table(0), std::memory_order_release);
+    }
+
+    ConcurrentHashTable(const ConcurrentHashTable&) = delete;
+    ConcurrentHashTable& operator=(const ConcurrentHashTable&) = delete;
+
+    // Moving and swapping are not safe while either table is in use.
+    ConcurrentHashTable(ConcurrentHashTable&& other)
+      : ConcurrentHashTable(other.alpha_, other.prober_, other.hash_, other.eq_, other.stripeCount_)
+    {
+        swap(other);
+    }
+
+    ~ConcurrentHashTable() {
+        Table* t = table_.load(std::memory_order_relaxed);
+        for (HASH_INDEX_T i = 0; i < t->m; ++i) {
+            Node* n = t->slots[i].load(std::memory_order_relaxed);
+            if (n && n != tombstone()) delete n;
+        }
+        delete t;
+        freeRetired();
+    }
+
+    void swap(ConcurrentHashTable& other) {
+        std::swap(prober_, other.prober_);
+        std::swap(hash_, other.hash_);
+        std::swap(eq_, other.eq_);
+        std::swap(alpha_, other.alpha_);
+        std::swap(stripeCount_, other.stripeCount_);
+        stripes_.swap(other.stripes_);
+        table_.store(other.table_.exchange(table_.load()));
+        count_.store(other.count_.exchange(count_.load()));
+        used_.store(other.used_.exchange(used_.load()));
+        retiredTables_.swap(other.retiredTables_);
+#ifdef HT_STATS
+        totalProbes_.store(other.totalProbes_.exchange(totalProbes_.load()));
+#endif
+    }
+
+    // Approximate while writers are running.
+    size_t size() const { return count_.load(std::memory_order_relaxed); }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return table_.load(std::memory_order_acquire)->m; }
+
+    // ----- Lookups: any number of threads, concurrently with writers -----
+
+    // The item stays valid, with the value it had when it was found, until
+    // reclaim(); a later insert of the key replaces it rather than changing it.
+    const ItemType* find(const KeyType& key) const {
+        const Node* n = findNode(key);
+        return n ? &n->item : nullptr;
+    }
+
+    bool contains(const KeyType& key) const { return findNode(key) != nullptr; }
+
+    // Copy out the value, which stays correct after reclaim()
+    bool lookup(const KeyType& key, ValueType& out) const {
+        const Node* n = findNode(key);
+        if (!n) return false;
+        out = n->item.second;
+        return true;
+    }
+
+    const Hasher& hasher() const { return hash_; }
+    const ProberType& prober() const { return prober_; }
+
+    // ----- Updates: any number of threads -----
+
+    // Insert p, or replace the value of an existing key.
+    void insert(const ItemType& p) {
+        HASH_INDEX_T h = hash_(p.first);
+        HASH_INDEX_T ph = probeKeyHash(prober_, p.first);
+        Stripe& s = stripe(h);
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(s.lock);
+                Table* t = table_.load(std::memory_order_acquire);
+                if (!needsGrow(*t) && insertLocked(*t, p, h, ph, s)) return;
+            }
+            grow();
+        }
+    }
+
+    // Returns whether the key was there.
+    bool remove(const KeyType& key) {
+        HASH_INDEX_T h = hash_(key);
+        Stripe& s = stripe(h);
+        std::lock_guard<std::mutex> lock(s.lock);
+        Table* t = table_.load(std::memory_order_acquire);
+        ProberType prober = prober_;
+        startProbe(prober, Capacity::home(h, t->m), t->m, probeKeyHash(prober_, key), key);
+        for (HASH_INDEX_T i = 0; i < t->m; ++i) {
+            HASH_INDEX_T loc = prober.next();
+            if (loc == npos) return false;
+            Node* n = t->slots[loc].load(std::memory_order_acquire);
+            if (!n) return false;
+            if (matches(n, h, key)) {
+                t->slots[loc].store(tombstone(), std::memory_order_release);
+                s.retired.push_back(n);
+                count_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Grow (never shrink) to the smallest capacity that takes n items.
+    void reserve(size_t n) {
+        AllStripes lock(*this);
+        Table* t = table_.load(std::memory_order_relaxed);
+        size_t i = t->index;
+        while (n > 0 && double(n - 1) / Capacity::sizes[i] >= alpha_) {
+            if (++i >= Capacity::count)
+                throw std::logic_error("No more capacities");
+        }
+        if (i != t->index) rebuild(i);
+    }
+
+    // Free the nodes and slot arrays that writers have retired. Every
+    // pointer from an earlier find() becomes invalid, so no lookup may be
+    // running: call it at a quiescent point, e.g. between solver batches.
+    void reclaim() {
+        AllStripes lock(*this);
+        freeRetired();
+    }
+
+#ifdef HT_STATS
+    size_t totalProbes() const { return totalProbes_.load(std::memory_order_relaxed); }
+    void clearTotalProbes() { totalProbes_.store(0, std::memory_order_relaxed); }
+    double loadFactor() const { return double(size()) / capacity(); }
+#endif
+
+private:
+    typedef typename ProberType::Capacity Capacity;
+    static const HASH_INDEX_T npos = ProberType::npos;
+
+    struct Node {
+        const ItemType     item;
+        const HASH_INDEX_T hash, probeHash;
+        Node(const ItemType& p, HASH_INDEX_T h, HASH_INDEX_T ph)
+          : item(p), hash(h), probeHash(ph) {}
+    };
+
+    struct Table {
+        const size_t       index;
+        const HASH_INDEX_T m;
+        std::unique_ptr<std::atomic<Node*>[]> slots;
+        explicit Table(size_t i)
+          : index(i), m(Capacity::sizes[i]), slots(new std::atomic<Node*>[m])
+        {
+            for (HASH_INDEX_T j = 0; j < m; ++j)
+                slots[j].store(nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    // a cache line each, so writers on neighbouring stripes do not contend
+    struct alignas(64) Stripe {
+        std::mutex         lock;
+        std::vector<Node*> retired;
+    };
+
+    // Locks every stripe in order, which excludes all other writers
+    struct AllStripes {
+        ConcurrentHashTable& t;
+        explicit AllStripes(ConcurrentHashTable& table) : t(table) {
+            for (size_t i = 0; i < t.stripeCount_; ++i) t.stripes_[i].lock.lock();
+        }
+        ~AllStripes() {
+            for (size_t i = t.stripeCount_; i-- > 0; ) t.stripes_[i].lock.unlock();
+        }
+    };
+
+    // marks a removed item; never dereferenced
+    static Node* tombstone() {
+        static char tag;
+        return reinterpret_cast<Node*>(&tag);
+    }
+
+    Stripe& stripe(HASH_INDEX_T h) const {
+        return stripes_[PowerOfTwoCapacity::mix(h) & (stripeCount_ - 1)];
+    }
+
+    bool matches(const Node* n, HASH_INDEX_T h, const KeyType& key) const {
+        return n != tombstone() && n->hash == h && eq_(n->item.first, key);
+    }
+
+    const Node* findNode(const KeyType& key) const {
+        HASH_INDEX_T h = hash_(key);
+        const Table* t = table_.load(std::memory_order_acquire);
+        ProberType prober = prober_;
+        startProbe(prober, Capacity::home(h, t->m), t->m, probeKeyHash(prober_, key), key);
+        for (HASH_INDEX_T i = 0; i < t->m; ++i) {
+            HASH_INDEX_T loc = prober.next();
+            HT_STATS_ONLY(totalProbes_.fetch_add(1, std::memory_order_relaxed);)
+            if (loc == npos) return nullptr;
+            const Node* n = t->slots[loc].load(std::memory_order_acquire);
+            if (!n) return nullptr;
+            if (matches(n, h, key)) return n;
+        }
+        return nullptr;
+    }
+
+    bool needsGrow(const Table& t) const {
+        return double(used_.load(std::memory_order_relaxed)) / t.m >= alpha_;
+    }
+
+    // With s locked: replace the key's node, or claim the first empty slot
+    // if the key is absent. Writers on other stripes may claim slots along
+    // the way; a failed claim just moves on. Returns false if the probe
+    // sequence ran out, which only happens when concurrent claims have
+    // filled the table past alpha.
+    bool insertLocked(Table& t, const ItemType& p, HASH_INDEX_T h, HASH_INDEX_T ph, Stripe& s) {
+        std::unique_ptr<Node> fresh(new Node(p, h, ph));
+        ProberType prober = prober_;
+        startProbe(prober, Capacity::home(h, t.m), t.m, ph, p.first);
+        for (HASH_INDEX_T i = 0; i < t.m; ++i) {
+            HASH_INDEX_T loc = prober.next();
+            HT_STATS_ONLY(totalProbes_.fetch_add(1, std::memory_order_relaxed);)
+            if (loc == npos) return false;
+            std::atomic<Node*>& slot = t.slots[loc];
+            Node* n = slot.load(std::memory_order_acquire);
+            if (!n) {
+                if (slot.compare_exchange_strong(n, fresh.get(),
+                                                 std::memory_order_release,
+                                                 std::memory_order_acquire)) {
+                    fresh.release();
+                    count_.fetch_add(1, std::memory_order_relaxed);
+                    used_.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                // lost the slot to another stripe's key; n is that key
+            }
+            if (matches(n, h, p.first)) {
+                slot.store(fresh.release(), std::memory_order_release);
+                s.retired.push_back(n);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Called with no stripe held. Another writer may have grown the table
+    // while this one waited for the locks, hence the second check.
+    void grow() {
+        AllStripes lock(*this);
+        Table* t = table_.load(std::memory_order_relaxed);
+        if (!needsGrow(*t)) return;
+        // dropping the tombstones may be enough (see HashTable::rehashIsEnough)
+        size_t live = count_.load(std::memory_order_relaxed);
+        if (2.0 * (live + 1) <= alpha_ * t->m) rebuild(t->index);
+        else if (t->index + 1 >= Capacity::count) throw std::logic_error("No more capacities");
+        else rebuild(t->index + 1);
+    }
+
+    // With every stripe held: place the live nodes of the current array in
+    // a new one of capacity sizes[newIndex], then publish it. The old array
+    // is retired, since readers may still be probing it.
+    void rebuild(size_t newIndex) {
+        Table* old = table_.load(std::memory_order_relaxed);
+        std::unique_ptr<Table> t(new Table(newIndex));
+        size_t live = 0;
+        for (HASH_INDEX_T i = 0; i < old->m; ++i) {
+            Node* n = old->slots[i].load(std::memory_order_relaxed);
+            if (!n || n == tombstone()) continue;
+            ProberType prober = prober_;
+            startProbe(prober, Capacity::home(n->hash, t->m), t->m, n->probeHash, n->item.first);
+            for (;;) {
+                HASH_INDEX_T loc = prober.next();
+                if (loc == npos) throw std::logic_error("HashTable full");
+                if (!t->slots[loc].load(std::memory_order_relaxed)) {
+                    t->slots[loc].store(n, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            ++live;
+        }
+        count_.store(live, std::memory_order_relaxed);
+        used_.store(live, std::memory_order_relaxed);
+        table_.store(t.release(), std::memory_order_release);
+        retiredTables_.push_back(old);
+    }
+
+    void freeRetired() {
+        for (size_t i = 0; i < stripeCount_; ++i) {
+            for (Node* n : stripes_[i].retired) delete n;
+            stripes_[i].retired.clear();
+        }
+        for (Table* t : retiredTables_) delete t;
+        retiredTables_.clear();
+    }
+
+    ProberType                 prober_;
+    Hasher                     hash_;
+    KeyEqual                   eq_;
+    double                     alpha_;
+    size_t                     stripeCount_;
+    std::unique_ptr<Stripe[]>  stripes_;
+    std::atomic<Table*>        table_;
+    std::atomic<size_t>        count_, used_;
+    // only touched with every stripe held
+    std::vector<Table*>        retiredTables_;
+#ifdef HT_STATS
+    mutable std::atomic<size_t> totalProbes_;
+#endif
+};
+
+#endif // CONCURRENT_HT_H
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <string>
+#include <exception>
+
+#include "trie.h"
+#include "boggle.h"
+
+using namespace std;
+
+// Compile a word list into the binary trie format that boggle-driver (and
+// parseDictTrie) map directly instead of parsing.
+int main(int argc, char* argv[])
+{
+	if(argc < 3)
+	{
+		cout << "Usage: dict-compile <dictionary file> <output file>" << endl;
+		exit(1);
+	}
+	try
+	{
+		Trie dictionary = parseDictTrie(string(argv[1]));
+		dictionary.save(string(argv[2]));
+		cout << "Wrote " << dictionary.wordCount() << " words, "
+		     << dictionary.nodeCount() << " nodes to " << argv[2] << endl;
+	}
+	catch(exception& e)
+	{
+		cout << "Error: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,486 @@
+#ifndef FLAT_HT_H
+#define FLAT_HT_H
+
+#include <vector>
+#include <memory>
+#include <new>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "ht.h"
+
+// --------------------------- Control bytes ---------------------------------
+//
+// One signed byte per slot: EMPTY and DELETED have the high bit set, a full
+// slot holds a 7-bit fragment of its key's hash. Comparing a fragment rules
+// out almost every non-matching slot without touching the key.
+
+typedef signed char ctrl_t;
+
+static const ctrl_t CTRL_EMPTY   = -128;  // 0x80
+static const ctrl_t CTRL_DELETED = -2;    // 0xFE
+
+inline ctrl_t ctrlFragment(HASH_INDEX_T h)
+{
+    // Fibonacci multiply so that a hash with small magnitude (MyStringHash
+    // on short keys) still spreads over all 7 bits.
+    return static_cast<ctrl_t>((static_cast<unsigned long long>(h) * 0x9E3779B97F4A7C15ULL) >> 57);
+}
+
+// Bitmask matches over 16 consecutive control bytes. Bit i is set when byte
+// i matches. Uses SSE2 when the compiler targets it (always on x86-64; an
+// -mavx2 build gets the same code VEX-encoded) and a portable loop otherwise.
+struct CtrlGroup {
+    static const unsigned width = 16;
+
+#if defined(__SSE2__)
+    static unsigned match(const ctrl_t* g, ctrl_t b) {
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g));
+        return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(b), ctrl)));
+    }
+    static unsigned matchEmpty(const ctrl_t* g) {
+        return match(g, CTRL_EMPTY);
+    }
+    static unsigned matchEmptyOrDeleted(const ctrl_t* g) {
+        // high bit set <=> EMPTY or DELETED
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(g));
+        return static_cast<unsigned>(_mm_movemask_epi8(ctrl));
+    }
+#else
+    static unsigned match(const ctrl_t* g, ctrl_t b) {
+        unsigned bits = 0;
+        for (unsigned i = 0; i < width; ++i)
+            bits |= unsigned(g[i] == b) << i;
+        return bits;
+    }
+    static unsigned matchEmpty(const ctrl_t* g) {
+        return match(g, CTRL_EMPTY);
+    }
+    static unsigned matchEmptyOrDeleted(const ctrl_t* g) {
+        unsigned bits = 0;
+        for (unsigned i = 0; i < width; ++i)
+            bits |= unsigned(g[i] < 0) << i;
+        return bits;
+    }
+#endif
+
+    static unsigned lowest(unsigned bits) { return __builtin_ctz(bits); }
+};
+
+// -------------------------- FlatHashTable ----------------------------------
+//
+// Same interface and probing behaviour as HashTable, but the key/value pairs
+// live inline in one contiguous slot array next to a one-byte-per-slot
+// control array. A probe step reads a control byte and (only when the hash
+// fragment matches) the item itself, instead of chasing a heap pointer, and
+// inserts do not allocate.
+//
+// With GroupProber the table instead scans 16 control bytes per step and
+// reuses tombstones on insert, SwissTable style; totalProbes() then counts
+// groups rather than slots.
+
+template<
+    typename K,
+    typename V,
+    typename ProberType = LinearProber<K>,
+    typename Hash       = std::hash<K>,
+    typename KeyEqual   = std::equal_to<K>
+>
+class FlatHashTable {
+public:
+    using KeyType   = K;
+    using ValueType = V;
+    using ItemType  = std::pair<KeyType,ValueType>;
+    using Hasher    = Hash;
+
+    FlatHashTable(double alpha = 0.4,
+                  const ProberType& prober = ProberType(),
+                  const Hasher& hash     = Hasher(),
+                  const KeyEqual& eq     = KeyEqual())
+      : prober_(prober)
+      , hash_(hash)
+      , eq_(eq)
+      , alpha_(alpha)
+      , totalProbes_(0)
+      , index_(0)
+      , count_(0)
+      , used_(0)
+      , capacity_(0)
+    {
+        allocate(Capacity::sizes[index_]);
+    }
+
+    // Build from a range of ItemType. For forward iterators the table is
+    // sized once up front so no resize happens while loading.
+    template<typename InputIt,
+             typename = typename std::iterator_traits<InputIt>::iterator_category>
+    FlatHashTable(InputIt first, InputIt last,
+                  double alpha = 0.4,
+                  const ProberType& prober = ProberType(),
+                  const Hasher& hash     = Hasher(),
+                  const KeyEqual& eq     = KeyEqual())
+      : FlatHashTable(alpha, prober, hash, eq)
+    {
+        reserveFor(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    FlatHashTable(const FlatHashTable&) = delete;
+    FlatHashTable& operator=(const FlatHashTable&) = delete;
+
+    ~FlatHashTable() {
+        destroyAll();
+    }
+
+    bool empty() const { return count_ == 0; }
+    size_t size()  const { return count_; }
+    size_t capacity() const { return capacity_; }
+
+    void insert(const ItemType& p) {
+        insert(p, hash_(p.first));
+    }
+
+    // Grow (never shrink) straight to the smallest capacity in sizes[] that
+    // takes n items without another resize.
+    void reserve(size_t n) {
+        size_t i = index_;
+        while (n > 0 && double(n - 1) / Capacity::sizes[i] >= alpha_) {
+            if (++i >= Capacity::count)
+                throw std::logic_error("No more capacities");
+        }
+        if (i != index_) rebuild(i);
+    }
+
+    // Drop every tombstone, keeping the current capacity.
+    void rehash() { rebuild(index_); }
+
+    // Rebuild at the smallest capacity in sizes[] (possibly the current
+    // one) that holds the current items below alpha.
+    void shrink_to_fit() {
+        size_t i = 0;
+        while (i < index_ && double(count_) / Capacity::sizes[i] >= alpha_) ++i;
+        rebuild(i);
+    }
+
+    void remove(const KeyType& key) {
+        HASH_INDEX_T loc = internalFind(key);
+        if (loc == npos) return;
+        // The slot stays a tombstone so later probe sequences are not cut
+        // short; the item itself can be destroyed right away.
+        item(loc).~ItemType();
+        setCtrl(loc, CTRL_DELETED);
+        --count_;
+    }
+
+    const ValueType& at(const KeyType& key) const {
+        HASH_INDEX_T loc = internalFind(key);
+        if (loc == npos) throw std::out_of_range("Bad key");
+        return item(loc).second;
+    }
+    ValueType& at(const KeyType& key) {
+        HASH_INDEX_T loc = internalFind(key);
+        if (loc == npos) throw std::out_of_range("Bad key");
+        return item(loc).second;
+    }
+
+    // operator[] overloads
+    ValueType& operator[](const KeyType& key) { return at(key); }
+    const ValueType& operator[](const KeyType& key) const { return at(key); }
+
+    ItemType* find(const KeyType& key) {
+        HASH_INDEX_T loc = internalFind(key);
+        return loc == npos ? nullptr : &item(loc);
+    }
+    const ItemType* find(const KeyType& key) const {
+        HASH_INDEX_T loc = internalFind(key);
+        return loc == npos ? nullptr : &item(loc);
+    }
+
+    void reportAll(std::ostream& out) const {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (isFull(i))
+                out << "Bucket " << i << ": "
+                    << item(i).first << " -> "
+                    << item(i).second << "\n";
+        }
+    }
+
+    // Batch operations: the keys of each block are hashed up front and the
+    // control bytes and slots of their home buckets prefetched, so those
+    // loads overlap instead of stalling one after another.
+    void insertBatch(const ItemType* items, size_t n) {
+        HASH_INDEX_T h[BATCH_BLOCK];
+        for (size_t b = 0; b < n; b += BATCH_BLOCK) {
+            size_t k = n - b < BATCH_BLOCK ? n - b : BATCH_BLOCK;
+            for (size_t i = 0; i < k; ++i) {
+                h[i] = hash_(items[b + i].first);
+                prefetchHome(h[i]);
+            }
+            for (size_t i = 0; i < k; ++i)
+                insert(items[b + i], h[i]);
+        }
+    }
+
+    // out[i] receives find(keys[i])
+    void findBatch(const KeyType* keys, size_t n, ItemType** out) {
+        HASH_INDEX_T locs[BATCH_BLOCK];
+        for (size_t b = 0; b < n; b += BATCH_BLOCK) {
+            size_t k = n - b < BATCH_BLOCK ? n - b : BATCH_BLOCK;
+            internalFindBatch(keys + b, k, locs);
+            for (size_t i = 0; i < k; ++i)
+                out[b + i] = locs[i] == npos ? nullptr : &item(locs[i]);
+        }
+    }
+    void findBatch(const KeyType* keys, size_t n, const ItemType** out) const {
+        HASH_INDEX_T locs[BATCH_BLOCK];
+        for (size_t b = 0; b < n; b += BATCH_BLOCK) {
+            size_t k = n - b < BATCH_BLOCK ? n - b : BATCH_BLOCK;
+            internalFindBatch(keys + b, k, locs);
+            for (size_t i = 0; i < k; ++i)
+                out[b + i] = locs[i] == npos ? nullptr : &item(locs[i]);
+        }
+    }
+
+    void clearTotalProbes() { totalProbes_ = 0; }
+    size_t totalProbes() const { return totalProbes_; }
+
+#ifdef HT_STATS
+    const HashTableStats& stats() const { return stats_; }
+    void clearStats() { stats_.clear(); }
+    size_t tombstones() const { return used_ - count_; }
+    double loadFactor() const { return double(count_) / capacity_; }
+    size_t longestCluster() const {
+        const std::vector<ctrl_t>& c = ctrl_;
+        return ::longestCluster(capacity_, [&c](size_t i) { return c[i] != CTRL_EMPTY; });
+    }
+    void reportStats(std::ostream& out) const {
+        out << "size " << count_ << ", capacity " << capacity_
+            << ", load " << loadFactor() << ", tombstones " << tombstones()
+            << ", longest cluster " << longestCluster() << "\n";
+        stats_.report(out);
+    }
+#endif
+
+private:
+    typedef typename ProberType::Capacity Capacity;
+    static const HASH_INDEX_T npos = ProberType::npos;
+    static const size_t BATCH_BLOCK = 16;
+    typedef std::integral_constant<bool, (ProberType::groupWidth > 1)> GroupMode;
+    static_assert(ProberType::groupWidth == 1 || ProberType::groupWidth == CtrlGroup::width,
+                  "group probers must match the control byte group width");
+    static_assert(!ProberType::robinHood, "Robin Hood order is only kept by HashTable");
+
+    // Raw, suitably aligned storage for one ItemType; only full slots hold a
+    // constructed item.
+    typedef typename std::aligned_storage<sizeof(ItemType), alignof(ItemType)>::type Slot;
+
+    ItemType& item(HASH_INDEX_T loc) {
+        return *reinterpret_cast<ItemType*>(&slots_[loc]);
+    }
+    const ItemType& item(HASH_INDEX_T loc) const {
+        return *reinterpret_cast<const ItemType*>(&slots_[loc]);
+    }
+
+    bool isFull(HASH_INDEX_T loc) const { return ctrl_[loc] >= 0; }
+
+    void allocate(HASH_INDEX_T m) {
+        slots_.reset(new Slot[m]);
+        capacity_ = m;
+        // The trailing width-1 bytes mirror the first slots so that a group
+        // load starting anywhere in [0, m) stays inside the array.
+        ctrl_.assign(m + CtrlGroup::width - 1, CTRL_EMPTY);
+    }
+
+    // Write a control byte and keep its mirrored copies in sync.
+    void setCtrl(HASH_INDEX_T loc, ctrl_t c) {
+        ctrl_[loc] = c;
+        for (size_t j = loc + capacity_; j < ctrl_.size(); j += capacity_)
+            ctrl_[j] = c;
+    }
+
+    void fill(HASH_INDEX_T loc, HASH_INDEX_T h) {
+        if (ctrl_[loc] == CTRL_EMPTY) ++used_;
+        setCtrl(loc, ctrlFragment(h));
+        ++count_;
+    }
+
+    void insert(const ItemType& p, HASH_INDEX_T h) {
+        // Resize if loading factor >= alpha, unless that is mostly
+        // tombstones, in which case dropping them is enough
+        if (double(used_) / capacity_ >= alpha_) {
+            if (rehashIsEnough()) rehash();
+            else resize();
+        }
+        bool found;
+        HT_STATS_ONLY(size_t before = totalProbes_;)
+        HASH_INDEX_T loc = locate(p.first, h, found);
+        HT_STATS_ONLY(stats_.record(HashTableStats::INSERT, totalProbes_ - before);)
+        if (loc == npos)
+            throw std::logic_error("HashTable full");
+        if (found) {
+            item(loc).second = p.second;
+        } else {
+            new (&slots_[loc]) ItemType(p);
+            fill(loc, h);
+        }
+    }
+
+    void prefetchHome(HASH_INDEX_T h) const {
+        HASH_INDEX_T loc = Capacity::home(h, capacity_);
+        HT_PREFETCH(&ctrl_[loc]);
+        HT_PREFETCH(&slots_[loc]);
+    }
+
+    void destroyAll() {
+        for (size_t i = 0; i < capacity_; ++i)
+            if (isFull(i)) item(i).~ItemType();
+    }
+
+    // Returns the slot holding key (found = true) or the slot where it
+    // should be inserted (found = false), or npos if the table is full.
+    HASH_INDEX_T locate(const KeyType& key, HASH_INDEX_T h, bool& found) const {
+        return locate(key, h, found, GroupMode());
+    }
+
+    // One slot per step, HashTable semantics: stop at the key or the first
+    // empty slot, stepping over tombstones.
+    HASH_INDEX_T locate(const KeyType& key, HASH_INDEX_T h, bool& found, std::false_type) const {
+        HASH_INDEX_T m = capacity_;
+        ctrl_t frag = ctrlFragment(h);
+        prober_.init(Capacity::home(h, m), m, key);
+        found = false;
+        for (size_t i = 0; i < m; ++i) {
+            HASH_INDEX_T loc = prober_.next();
+            ++totalProbes_;
+            if (loc == npos) return npos;
+            ctrl_t c = ctrl_[loc];
+            if (c == CTRL_EMPTY) return loc;
+            if (c == frag && eq_(item(loc).first, key)) {
+                found = true;
+                return loc;
+            }
+        }
+        return npos;
+    }
+
+    // One group per step: check every fragment match in the group, stop at
+    // the first group with an empty slot, then insert into the first empty
+    // or deleted slot along the same sequence.
+    HASH_INDEX_T locate(const KeyType& key, HASH_INDEX_T h, bool& found, std::true_type) const {
+        HASH_INDEX_T m = capacity_;
+        ctrl_t frag = ctrlFragment(h);
+        HASH_INDEX_T start = Capacity::home(h, m);
+        prober_.init(start, m, key);
+        found = false;
+        for (HASH_INDEX_T pos = prober_.next(); pos != npos; pos = prober_.next()) {
+            ++totalProbes_;
+            const ctrl_t* g = &ctrl_[pos];
+            for (unsigned bits = CtrlGroup::match(g, frag); bits; bits &= bits - 1) {
+                HASH_INDEX_T loc = wrap(pos + CtrlGroup::lowest(bits));
+                if (eq_(item(loc).first, key)) {
+                    found = true;
+                    return loc;
+                }
+            }
+            if (CtrlGroup::matchEmpty(g)) break;
+        }
+        prober_.init(start, m, key);
+        for (HASH_INDEX_T pos = prober_.next(); pos != npos; pos = prober_.next()) {
+            unsigned bits = CtrlGroup::matchEmptyOrDeleted(&ctrl_[pos]);
+            if (bits) return wrap(pos + CtrlGroup::lowest(bits));
+        }
+        return npos;
+    }
+
+    HASH_INDEX_T wrap(HASH_INDEX_T loc) const {
+        return loc < capacity_ ? loc : Capacity::wrap(loc, capacity_);
+    }
+
+    HASH_INDEX_T internalFind(const KeyType& key) const {
+        return internalFind(key, hash_(key));
+    }
+
+    HASH_INDEX_T internalFind(const KeyType& key, HASH_INDEX_T h) const {
+        bool found;
+        HT_STATS_ONLY(size_t before = totalProbes_;)
+        HASH_INDEX_T loc = locate(key, h, found);
+        HT_STATS_ONLY(stats_.record(found ? HashTableStats::HIT : HashTableStats::MISS,
+                                    totalProbes_ - before);)
+        return found ? loc : npos;
+    }
+
+    void internalFindBatch(const KeyType* keys, size_t k, HASH_INDEX_T* out) const {
+        HASH_INDEX_T h[BATCH_BLOCK];
+        hashKeys(hash_, keys, k, h);
+        for (size_t i = 0; i < k; ++i)
+            prefetchHome(h[i]);
+        for (size_t i = 0; i < k; ++i)
+            out[i] = internalFind(keys[i], h[i]);
+    }
+
+    template<typename It>
+    void reserveFor(It first, It last, std::forward_iterator_tag) {
+        reserve(size() + std::distance(first, last));
+    }
+    template<typename It>
+    void reserveFor(It, It, std::input_iterator_tag) {}
+
+    void resize() {
+        if (index_ + 1 >= Capacity::count)
+            throw std::logic_error("No more capacities");
+        rebuild(index_ + 1);
+    }
+
+    // see HashTable::rehashIsEnough()
+    bool rehashIsEnough() const {
+        return 2.0 * (count_ + 1) <= alpha_ * capacity_;
+    }
+
+    // Rebuild at capacity sizes[newIndex], dropping tombstones.
+    void rebuild(size_t newIndex) {
+        HT_STATS_ONLY(ResizeTimer timer(stats_);)
+        std::unique_ptr<Slot[]> oldSlots(std::move(slots_));
+        std::vector<ctrl_t> oldCtrl;
+        oldCtrl.swap(ctrl_);
+        HASH_INDEX_T oldCapacity = capacity_;
+        index_ = newIndex;
+        allocate(Capacity::sizes[index_]);
+        count_ = used_ = 0;
+        // Move every live item straight into its new slot; the keys are
+        // known to be distinct so there is no need to go through insert().
+        for (size_t i = 0; i < oldCapacity; ++i) {
+            if (oldCtrl[i] < 0) continue;
+            ItemType& p = *reinterpret_cast<ItemType*>(&oldSlots[i]);
+            HASH_INDEX_T h = hash_(p.first);
+            bool found;
+            HASH_INDEX_T loc = locate(p.first, h, found);
+            new (&slots_[loc]) ItemType(std::move(p));
+            fill(loc, h);
+            p.~ItemType();
+        }
+    }
+
+    mutable ProberType         prober_;
+    Hasher                     hash_;
+    KeyEqual                   eq_;
+    double                     alpha_;
+    mutable size_t             totalProbes_;
+    size_t                     index_, count_, used_;
+    HASH_INDEX_T               capacity_;
+    std::unique_ptr<Slot[]>    slots_;
+    std::vector<ctrl_t>        ctrl_;
+#ifdef HT_STATS
+    mutable HashTableStats     stats_;
+#endif
+};
+
+#endif // FLAT_HT_H
@@ -11,6 +11,9 @@
 #include <iostream>
 #include <cstdlib>
 #include <string>
+#include <cctype>
+#include <random>
+#include <set>
 
 using namespace std;
 
@@ -114,4 +117,43 @@ TEST(HashFunc,TestRandomize){
 	}
 	set<size_t> hash_unique_vals(hash_values.begin(),hash_values.end());
 	EXPECT_EQ(hash_values.size(),hash_unique_vals.size());
-}
\ No newline at end of file
+}
+
+// straightforward per-group version of the hash, kept here to check that
+// the table-driven MyStringHash stays bit-identical
+static size_t referenceHash(const MyStringHash& hk, const string& k){
+	unsigned long long w[5] = {0, 0, 0, 0, 0};
+	long long len = k.size();
+	for(int group = 0; group < 5; ++group){
+		unsigned long long val = 0;
+		long long end = len - group * 6;
+		long long start = end - 6 < 0 ? 0 : end - 6;
+		for(long long i = start; i < end; ++i){
+			unsigned char uc = k[i];
+			unsigned long long d = 0;
+			if(isalpha(uc)) d = tolower(uc) - 'a';
+			else if(isdigit(uc)) d = 26 + (uc - '0');
+			val = val * 36 + d;
+		}
+		w[4 - group] = val;
+	}
+	unsigned long long h = 0;
+	for(int i = 0; i < 5; ++i){
+		h += static_cast<unsigned long long>(hk.rValues[i]) * w[i];
+	}
+	return h;
+}
+
+TEST(HashFunc,MatchesReference){
+	const string alphabet("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789");
+	MyStringHash hashk(true);
+	std::mt19937 gen(104);
+	for(int i = 0; i < 10000; i++){
+		string k;
+		size_t len = gen() % 40;
+		for(size_t j = 0; j < len; j++){
+			k.push_back(alphabet[gen() % alphabet.size()]);
+		}
+		EXPECT_EQ(hashk(k), referenceHash(hashk, k)) << k;
+	}
+}
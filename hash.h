@@ -5,10 +5,31 @@
 #include <cmath>
 #include <random>
 #include <chrono>
-#include <cctype>    // for std::tolower, std::isalpha, std::isdigit
+#include <string>
+#include <string_view>
 
 typedef std::size_t HASH_INDEX_T;
 
+// base-36 digit of every byte: a-z/A-Z -> 0-25, 0-9 -> 26-35, anything else 0
+static constexpr unsigned char HASH_DIGITS[256] = {
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    26,27,28,29,30,31,32,33,34,35, 0, 0, 0, 0, 0, 0,
+     0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,
+    15,16,17,18,19,20,21,22,23,24,25, 0, 0, 0, 0, 0,
+     0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,
+    15,16,17,18,19,20,21,22,23,24,25, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
 struct MyStringHash {
     // debug defaults to the preset rValues
     HASH_INDEX_T rValues[5] { 983132572, 1468777056, 552714139, 984953261, 261934300 };
@@ -20,46 +41,63 @@ struct MyStringHash {
         }
     }
 
-    // hash entry point
-    HASH_INDEX_T operator()(const std::string& k) const
+    // hashes any string type alike, so tables may look up by string_view
+    using is_transparent = void;
+
+    // hash entry point; strings with another allocator (e.g. ArenaString)
+    // hash the same
+    template <typename Traits, typename Alloc>
+    HASH_INDEX_T operator()(const std::basic_string<char, Traits, Alloc>& k) const
+    {
+        return hash(k.data(), k.size());
+    }
+    HASH_INDEX_T operator()(std::string_view k) const
     {
-        // break k into up to 5 chunks of 6 chars, right-aligned
-        unsigned long long w[5] = {0, 0, 0, 0, 0};
-        const size_t len = k.size();
-
-        for (int group = 0; group < 5; ++group) {
-            unsigned long long val = 0;
-            // compute window [start, end) for this group
-            long long end    = static_cast<long long>(len) - group * 6;
-            long long start  = end - 6;
-            if (end > 0) {
-                if (start < 0) start = 0;
-                for (long long i = start; i < end; ++i) {
-                    val = val * 36 + letterDigitToNumber(k[i]);
-                }
-            }
-            // store into w[0..4] so that w[4] is the last-6-chars chunk
-            w[4 - group] = val;
+        return hash(k.data(), k.size());
+    }
+
+    // Break the key into up to 5 chunks of 6 chars, right-aligned, so that
+    // w[4] is the last-6-chars chunk. The last (up to) 30 digits are copied
+    // into a zero-padded buffer; leading zero digits do not change a chunk's
+    // value, so every chunk is then a fixed 6-step Horner sum with no
+    // per-group bounds logic.
+    HASH_INDEX_T hash(const char* s, size_t len) const
+    {
+        unsigned char d[30] = {0};
+        const size_t n = len < 30 ? len : 30;
+        const unsigned char* tail = reinterpret_cast<const unsigned char*>(s) + (len - n);
+        for (size_t i = 0; i < n; ++i) {
+            d[30 - n + i] = HASH_DIGITS[tail[i]];
         }
 
         // combine with rValues
         unsigned long long h = 0;
         for (int i = 0; i < 5; ++i) {
-            h += static_cast<unsigned long long>(rValues[i]) * w[i];
+            const unsigned char* c = d + 6 * i;
+            unsigned long long w = c[0];
+            w = w * 36 + c[1];
+            w = w * 36 + c[2];
+            w = w * 36 + c[3];
+            w = w * 36 + c[4];
+            w = w * 36 + c[5];
+            h += static_cast<unsigned long long>(rValues[i]) * w;
         }
         return h;
     }
 
+    // hash n keys into out[]; independent keys let the chunk arithmetic of
+    // neighbouring keys overlap
+    void hashBatch(const std::string* keys, size_t n, HASH_INDEX_T* out) const
+    {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = hash(keys[i].data(), keys[i].size());
+        }
+    }
+
     // map a–z → 0–25 and 0–9 → 26–35 (case-insensitive)
     HASH_INDEX_T letterDigitToNumber(char c) const
     {
-        unsigned char uc = static_cast<unsigned char>(c);
-        if (std::isalpha(uc)) {
-            return std::tolower(uc) - 'a';
-        } else if (std::isdigit(uc)) {
-            return 26 + (uc - '0');
-        }
-        return 0;  // should never happen under the problem constraints
+        return HASH_DIGITS[static_cast<unsigned char>(c)];
     }
 
     // generate 5 random rValues at instantiation
@@ -73,4 +111,68 @@ struct MyStringHash {
     }
 };
 
+// MyStringHash of a string built up one character at a time: push_back(c)
+// turns the hash of s into the hash of s + c in constant time. Appending
+// shifts the 30-digit window left by one digit, so every chunk drops its
+// leading digit and takes in the leading digit of the chunk after it; the
+// last chunk takes the new character and the first chunk's digit falls out
+// of the window, exactly as MyStringHash keeps only the last 30 characters.
+// The window's digits are kept in a ring so no step needs a division.
+class RollingStringHash {
+public:
+    explicit RollingStringHash(const MyStringHash& h = MyStringHash()) : hash_(h)
+    {
+        clear();
+    }
+
+    // back to the hash of ""
+    void clear()
+    {
+        for (int i = 0; i < 5; ++i) {
+            w_[i] = 0;
+        }
+        for (int i = 0; i < 30; ++i) {
+            d_[i] = 0;
+        }
+        head_ = 0;
+    }
+
+    void push_back(char c)
+    {
+        static const unsigned long long LEAD = 36ULL * 36 * 36 * 36 * 36;
+        const unsigned char digit = HASH_DIGITS[static_cast<unsigned char>(c)];
+        unsigned char in = digit;
+        for (int i = 4; i >= 0; --i) {
+            unsigned pos = head_ + 6 * i;
+            if (pos >= 30) pos -= 30;
+            unsigned char out = d_[pos];
+            w_[i] = (w_[i] - out * LEAD) * 36 + in;
+            in = out;
+        }
+        // the oldest digit has left the window; its slot becomes the newest
+        d_[head_] = digit;
+        if (++head_ == 30) head_ = 0;
+    }
+
+    HASH_INDEX_T value() const { return value(hash_); }
+
+    // the same string hashed with another MyStringHash's rValues, so one
+    // rolling state serves several tables
+    HASH_INDEX_T value(const MyStringHash& h) const
+    {
+        unsigned long long v = 0;
+        for (int i = 0; i < 5; ++i) {
+            v += static_cast<unsigned long long>(h.rValues[i]) * w_[i];
+        }
+        return v;
+    }
+
+private:
+    MyStringHash hash_;
+    unsigned long long w_[5];
+    // digit i of the window is d_[(head_ + i) % 30]
+    unsigned char d_[30];
+    unsigned head_;
+};
+
 #endif
@@ -0,0 +1,1183 @@
+//
+// HashTable / FlatHashTable / ConcurrentHashTable / ShardedHashTable tests
+//
+// built with the probe statistics enabled so they can be checked too
+#define HT_STATS
+#include "ht.h"
+#include "flat-ht.h"
+#include "concurrent-ht.h"
+#include "sharded-ht.h"
+#include "arena.h"
+#include "ht-snapshot.h"
+#include "hash.h"
+#include <gtest/gtest.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <cstring>
+#include <cstddef>
+
+using namespace std;
+
+typedef HashTable<string, int, DoubleHashProber<string, MyStringHash>, MyStringHash> StrTable;
+typedef FlatHashTable<string, int, DoubleHashProber<string, MyStringHash>, MyStringHash> FlatStrTable;
+typedef ConcurrentHashTable<string, int, DoubleHashProber<string, MyStringHash>, MyStringHash> ConcStrTable;
+typedef ShardedHashTable<string, int, DoubleHashProber<string, MyStringHash>, MyStringHash> ShardedStrTable;
+
+static string key(int i){
+	stringstream ss;
+	ss << "key" << i;
+	return ss.str();
+}
+
+TEST(FlatHashTable,InsertFindRemove){
+	FlatStrTable ht;
+	for(int i = 0; i < 100; i++){
+		ht.insert({key(i), i});
+	}
+	EXPECT_EQ(ht.size(), 100u);
+	for(int i = 0; i < 100; i++){
+		ASSERT_NE(ht.find(key(i)), nullptr);
+		EXPECT_EQ(ht.at(key(i)), i);
+	}
+	EXPECT_EQ(ht.find("missing"), nullptr);
+	EXPECT_THROW(ht.at("missing"), std::out_of_range);
+	for(int i = 0; i < 100; i += 2){
+		ht.remove(key(i));
+	}
+	EXPECT_EQ(ht.size(), 50u);
+	for(int i = 0; i < 100; i++){
+		EXPECT_EQ(ht.find(key(i)) != nullptr, i % 2 == 1);
+	}
+	ht.insert({key(1), 42});
+	EXPECT_EQ(ht[key(1)], 42);
+	EXPECT_EQ(ht.size(), 50u);
+}
+
+TEST(FlatHashTable,ResizeLadder){
+	FlatHashTable<int, int> ht(0.4);
+	for(int i = 0; i < 5; i++){
+		ht.insert({i, i});
+	}
+	EXPECT_EQ(ht.capacity(), 11u);
+	ht.insert({5, 5});
+	EXPECT_EQ(ht.capacity(), 23u);
+}
+
+TEST(FlatHashTable,MatchesPointerTable){
+	StrTable a(0.7);
+	FlatStrTable b(0.7);
+	for(int i = 0; i < 2000; i++){
+		a.insert({key(i), i});
+		b.insert({key(i), i});
+	}
+	for(int i = 0; i < 2000; i += 3){
+		a.remove(key(i));
+		b.remove(key(i));
+	}
+	for(int i = 0; i < 4000; i++){
+		EXPECT_EQ(a.find(key(i)) != nullptr, b.find(key(i)) != nullptr);
+	}
+	EXPECT_EQ(a.size(), b.size());
+	EXPECT_EQ(a.totalProbes(), b.totalProbes());
+	stringstream sa, sb;
+	a.reportAll(sa);
+	b.reportAll(sb);
+	EXPECT_EQ(sa.str(), sb.str());
+}
+
+typedef FlatHashTable<string, int, GroupProber<string>, MyStringHash> GroupStrTable;
+
+TEST(FlatHashTable,GroupProbing){
+	GroupStrTable ht(0.7);
+	for(int i = 0; i < 5000; i++){
+		ht.insert({key(i), i});
+	}
+	EXPECT_EQ(ht.size(), 5000u);
+	for(int i = 0; i < 5000; i++){
+		ASSERT_NE(ht.find(key(i)), nullptr);
+		EXPECT_EQ(ht.at(key(i)), i);
+	}
+	for(int i = 5000; i < 10000; i++){
+		EXPECT_EQ(ht.find(key(i)), nullptr);
+	}
+	for(int i = 0; i < 5000; i += 2){
+		ht.remove(key(i));
+	}
+	EXPECT_EQ(ht.size(), 2500u);
+	for(int i = 0; i < 5000; i++){
+		EXPECT_EQ(ht.find(key(i)) != nullptr, i % 2 == 1);
+	}
+	// removed keys come back, reusing tombstones
+	for(int i = 0; i < 5000; i += 2){
+		ht.insert({key(i), -i});
+	}
+	EXPECT_EQ(ht.size(), 5000u);
+	EXPECT_EQ(ht.at(key(4)), -4);
+}
+
+TEST(FlatHashTable,GroupProbingSmallTable){
+	// capacity 11 is smaller than one group, so the mirrored control bytes
+	// wrap around more than once
+	FlatHashTable<int, int, GroupProber<int> > ht(0.9);
+	for(int i = 0; i < 9; i++){
+		ht.insert({i * 11, i});
+	}
+	EXPECT_EQ(ht.capacity(), 11u);
+	for(int i = 0; i < 9; i++){
+		EXPECT_EQ(ht.at(i * 11), i);
+	}
+	EXPECT_EQ(ht.find(1), nullptr);
+}
+
+TEST(FlatHashTable,GroupProbingFewerProbes){
+	FlatHashTable<string, int, LinearProber<string>, MyStringHash> lin(0.7);
+	GroupStrTable grp(0.7);
+	for(int i = 0; i < 3000; i++){
+		lin.insert({key(i), i});
+		grp.insert({key(i), i});
+	}
+	lin.clearTotalProbes();
+	grp.clearTotalProbes();
+	for(int i = 0; i < 6000; i++){
+		EXPECT_EQ(lin.find(key(i)) != nullptr, grp.find(key(i)) != nullptr);
+	}
+	EXPECT_LT(grp.totalProbes(), lin.totalProbes());
+}
+
+TEST(HashTable,Batch){
+	vector<StrTable::ItemType> items;
+	vector<string> keys;
+	for(int i = 0; i < 1000; i++){
+		items.push_back({key(i), i});
+	}
+	for(int i = 0; i < 2000; i++){
+		keys.push_back(key(i));
+	}
+	StrTable a(0.7);
+	FlatStrTable b(0.7);
+	a.insertBatch(items.data(), items.size());
+	b.insertBatch(items.data(), items.size());
+	EXPECT_EQ(a.size(), 1000u);
+	EXPECT_EQ(b.size(), 1000u);
+	vector<StrTable::ItemType*> ra(keys.size());
+	vector<const FlatStrTable::ItemType*> rb(keys.size());
+	a.findBatch(keys.data(), keys.size(), ra.data());
+	static_cast<const FlatStrTable&>(b).findBatch(keys.data(), keys.size(), rb.data());
+	for(size_t i = 0; i < keys.size(); i++){
+		EXPECT_EQ(ra[i], a.find(keys[i]));
+		EXPECT_EQ(rb[i], b.find(keys[i]));
+	}
+
+	MyStringHash h;
+	vector<size_t> hs(keys.size());
+	h.hashBatch(keys.data(), keys.size(), hs.data());
+	for(size_t i = 0; i < keys.size(); i++){
+		EXPECT_EQ(hs[i], h(keys[i]));
+	}
+}
+
+TEST(HashTable,Stats){
+	StrTable ht(0.7);
+	for(int i = 0; i < 1000; i++){
+		ht.insert({key(i), i});
+	}
+	EXPECT_EQ(ht.stats().count(HashTableStats::INSERT), 1000u);
+	EXPECT_EQ(ht.stats().resizes, 7u);
+	ht.clearStats();
+	ht.clearTotalProbes();
+	for(int i = 0; i < 2000; i++){
+		ht.find(key(i));
+	}
+	const HashTableStats& st = ht.stats();
+	EXPECT_EQ(st.count(HashTableStats::HIT), 1000u);
+	EXPECT_EQ(st.count(HashTableStats::MISS), 1000u);
+	EXPECT_EQ(st.histogram[HashTableStats::HIT][0], 0u);
+	EXPECT_GE(st.maxProbe[HashTableStats::MISS], 1u);
+	size_t total = 0;
+	for(int op = 0; op < HashTableStats::NUM_OPS; op++){
+		for(size_t i = 0; i < HashTableStats::HIST_SIZE; i++){
+			total += i * st.histogram[op][i];
+		}
+	}
+	EXPECT_EQ(total, ht.totalProbes());
+
+	for(int i = 0; i < 100; i++){
+		ht.remove(key(i));
+	}
+	EXPECT_EQ(ht.tombstones(), 100u);
+	EXPECT_DOUBLE_EQ(ht.loadFactor(), 900.0 / 1597);
+	EXPECT_GE(ht.longestCluster(), 1u);
+	stringstream ss;
+	ht.reportStats(ss);
+	EXPECT_NE(ss.str().find("tombstones 100"), string::npos);
+}
+
+TEST(FlatHashTable,LongestCluster){
+	// keys 0..4 land in buckets 0..4 and 10 in bucket 10: a wrapped run of 6
+	FlatHashTable<int, int> ht(0.9);
+	for(int i = 0; i < 5; i++){
+		ht.insert({i, i});
+	}
+	ht.insert({10, 10});
+	EXPECT_EQ(ht.longestCluster(), 6u);
+	EXPECT_EQ(ht.stats().count(HashTableStats::INSERT), 6u);
+	EXPECT_EQ(ht.stats().resizes, 0u);
+}
+
+TEST(HashTable,ChurnKeepsCapacity){
+	StrTable a(0.7);
+	FlatStrTable b(0.7);
+	GroupStrTable c(0.7);
+	for(int i = 0; i < 100; i++){
+		a.insert({key(i), i});
+		b.insert({key(i), i});
+		c.insert({key(i), i});
+	}
+	// steady size 100, but every insert uses a fresh key
+	for(int i = 100; i < 200000; i++){
+		a.remove(key(i - 100));
+		b.remove(key(i - 100));
+		c.remove(key(i - 100));
+		a.insert({key(i), i});
+		b.insert({key(i), i});
+		c.insert({key(i), i});
+	}
+	EXPECT_EQ(a.size(), 100u);
+	EXPECT_EQ(b.size(), 100u);
+	EXPECT_EQ(c.size(), 100u);
+	// 397 is the first capacity where 100 keys fill at most alpha/2, so the
+	// tables rehash in place there instead of growing
+	EXPECT_EQ(a.capacity(), 397u);
+	EXPECT_EQ(b.capacity(), 397u);
+	EXPECT_EQ(c.capacity(), 397u);
+	EXPECT_LE(a.tombstones(), 178u);
+	for(int i = 199900; i < 200000; i++){
+		EXPECT_EQ(a.at(key(i)), i);
+		EXPECT_EQ(b.at(key(i)), i);
+		EXPECT_EQ(c.at(key(i)), i);
+	}
+}
+
+TEST(HashTable,RehashAndShrink){
+	FlatStrTable ht(0.5);
+	for(int i = 0; i < 1000; i++){
+		ht.insert({key(i), i});
+	}
+	EXPECT_EQ(ht.capacity(), 3203u);
+	for(int i = 0; i < 990; i++){
+		ht.remove(key(i));
+	}
+	EXPECT_EQ(ht.tombstones(), 990u);
+	ht.rehash();
+	EXPECT_EQ(ht.capacity(), 3203u);
+	EXPECT_EQ(ht.tombstones(), 0u);
+	ht.shrink_to_fit();
+	EXPECT_EQ(ht.capacity(), 23u);
+	for(int i = 990; i < 1000; i++){
+		EXPECT_EQ(ht.at(key(i)), i);
+	}
+
+	StrTable pt(0.5);
+	for(int i = 0; i < 1000; i++){
+		pt.insert({key(i), i});
+	}
+	for(int i = 0; i < 990; i++){
+		pt.remove(key(i));
+	}
+	pt.shrink_to_fit();
+	EXPECT_DOUBLE_EQ(pt.loadFactor(), 10.0 / 23);
+	EXPECT_EQ(pt.tombstones(), 0u);
+	EXPECT_EQ(pt.find(key(5)), nullptr);
+	EXPECT_EQ(pt.at(key(995)), 995);
+}
+
+TEST(HashTable,Reserve){
+	StrTable a(0.4);
+	a.reserve(5);
+	EXPECT_EQ(a.capacity(), 11u);
+	a.reserve(6);
+	EXPECT_EQ(a.capacity(), 23u);
+	a.reserve(191852);
+	EXPECT_EQ(a.capacity(), 823117u);
+	a.reserve(10);
+	EXPECT_EQ(a.capacity(), 823117u);
+
+	FlatStrTable b(0.7);
+	b.reserve(1000);
+	size_t cap = b.capacity();
+	for(int i = 0; i < 1000; i++){
+		b.insert({key(i), i});
+	}
+	EXPECT_EQ(b.capacity(), cap);
+	EXPECT_EQ(b.stats().resizes, 1u);
+	EXPECT_THROW(b.reserve(size_t(-1) / 2), std::logic_error);
+}
+
+TEST(HashTable,RangeConstructor){
+	vector<StrTable::ItemType> items;
+	for(int i = 0; i < 5000; i++){
+		items.push_back({key(i), i});
+	}
+	StrTable a(items.begin(), items.end(), 0.6);
+	FlatStrTable b(items.begin(), items.end());
+	EXPECT_EQ(a.size(), 5000u);
+	EXPECT_EQ(b.size(), 5000u);
+	EXPECT_EQ(a.stats().resizes, 1u);
+	EXPECT_EQ(b.stats().resizes, 1u);
+	for(int i = 0; i < 5000; i++){
+		EXPECT_EQ(a.at(key(i)), i);
+		EXPECT_EQ(b.at(key(i)), i);
+	}
+}
+
+TEST(HashTable,CopyAndMove){
+	StrTable a;
+	for(int i = 0; i < 300; i++){
+		a.insert({key(i), i});
+	}
+	for(int i = 0; i < 300; i += 3){
+		a.remove(key(i));
+	}
+	StrTable b(a);
+	a.insert({key(1), -1});
+	EXPECT_EQ(b.size(), 200u);
+	EXPECT_EQ(b.tombstones(), a.tombstones());
+	for(int i = 0; i < 300; i++){
+		EXPECT_EQ(b.find(key(i)) != nullptr, i % 3 != 0) << i;
+	}
+	EXPECT_EQ(b.at(key(1)), 1);
+
+	StrTable c(std::move(b));
+	EXPECT_EQ(c.size(), 200u);
+	EXPECT_EQ(b.size(), 0u);
+	EXPECT_EQ(b.find(key(1)), nullptr);
+	b.insert({key(7), 7});
+	EXPECT_EQ(b.at(key(7)), 7);
+
+	c = a;
+	EXPECT_EQ(c.at(key(1)), -1);
+	a = std::move(b);
+	EXPECT_EQ(a.size(), 1u);
+	EXPECT_EQ(c.size(), 200u);
+}
+
+TEST(HashTable,RollingHashMatches){
+	mt19937 gen(7);
+	const char alphabet[] = "abcXYZ09-_ qQ";
+	for(int seed = 0; seed < 2; seed++){
+		MyStringHash h(seed == 0);
+		RollingStringHash roll(h);
+		string s;
+		EXPECT_EQ(roll.value(), h(s));
+		for(int i = 0; i < 70; i++){
+			char c = alphabet[gen() % (sizeof(alphabet) - 1)];
+			s.push_back(c);
+			roll.push_back(c);
+			ASSERT_EQ(roll.value(), h(s)) << s;
+			ASSERT_EQ(roll.value(MyStringHash()), MyStringHash()(s)) << s;
+		}
+		roll.clear();
+		EXPECT_EQ(roll.value(), h(""));
+	}
+}
+
+TEST(HashTable,FindByHash){
+	StrTable a;
+	HashTable<string, int, LinearProber<string>, MyStringHash> b;
+	for(int i = 0; i < 500; i++){
+		a.insert({key(i), i});
+		b.insert({key(i), i});
+	}
+	a.remove(key(3));
+	MyStringHash h;
+	for(int i = 0; i < 600; i++){
+		const StrTable::ItemType* p = a.findByHash(h(key(i)), key(i));
+		EXPECT_EQ(p, a.find(key(i))) << i;
+		EXPECT_EQ(a.findByHash(h(key(i)), a.prober().keyHash(key(i)), key(i)), p) << i;
+		EXPECT_EQ(b.findByHash(b.hasher()(key(i)), key(i)), b.find(key(i))) << i;
+	}
+	// a wrong hash finds nothing rather than a different key
+	EXPECT_EQ(a.findByHash(h(key(5)), key(6)), nullptr);
+}
+
+TEST(HashTable,PowerOfTwoCapacity){
+	typedef LinearProber<string, PowerOfTwoCapacity> Lin2;
+	typedef DoubleHashProber<string, MyStringHash, PowerOfTwoCapacity> Dbl2;
+	typedef GroupProber<string, PowerOfTwoCapacity> Grp2;
+	HashTable<string, int, Lin2, MyStringHash> a(0.7);
+	HashTable<string, int, Dbl2, MyStringHash> b(0.7);
+	FlatHashTable<string, int, Dbl2, MyStringHash> c(0.7);
+	FlatHashTable<string, int, Grp2, MyStringHash> d(0.7);
+	EXPECT_EQ(a.capacity(), 16u);
+	for(int i = 0; i < 5000; i++){
+		a.insert({key(i), i});
+		b.insert({key(i), i});
+		c.insert({key(i), i});
+		d.insert({key(i), i});
+	}
+	EXPECT_EQ(a.capacity(), 8192u);
+	EXPECT_EQ(d.capacity(), 8192u);
+	for(int i = 0; i < 10000; i++){
+		bool in = i < 5000;
+		EXPECT_EQ(a.find(key(i)) != nullptr, in);
+		EXPECT_EQ(b.find(key(i)) != nullptr, in);
+		EXPECT_EQ(c.find(key(i)) != nullptr, in);
+		EXPECT_EQ(d.find(key(i)) != nullptr, in);
+	}
+}
+
+TEST(HashTable,PowerOfTwoDoubleHashFullPeriod){
+	// an odd step reaches every slot, so a completely full table still works
+	typedef DoubleHashProber<string, MyStringHash, PowerOfTwoCapacity> Dbl2;
+	HashTable<string, int, Dbl2, MyStringHash> ht(1.0);
+	for(int i = 0; i < 16; i++){
+		ht.insert({key(i), i});
+	}
+	EXPECT_EQ(ht.capacity(), 16u);
+	for(int i = 0; i < 16; i++){
+		EXPECT_EQ(ht.at(key(i)), i);
+	}
+}
+
+// MyStringHash that counts its calls
+struct CountingHash {
+	MyStringHash h;
+	size_t* calls;
+	CountingHash(size_t* c = nullptr) : calls(c) {}
+	size_t operator()(const string& k) const {
+		if(calls) ++*calls;
+		return h(k);
+	}
+};
+
+TEST(HashTable,CachedHashResize){
+	size_t calls = 0, calls2 = 0;
+	typedef DoubleHashProber<string, CountingHash> CountingProber;
+	HashTable<string, int, CountingProber, CountingHash> ht(
+		0.4, CountingProber(CountingHash(&calls2)), CountingHash(&calls));
+	for(int i = 0; i < 10000; i++){
+		ht.insert({key(i), i});
+	}
+	// one primary and one secondary hash per insert, none during the
+	// 11 resizes
+	EXPECT_EQ(ht.stats().resizes, 11u);
+	EXPECT_EQ(calls, 10000u);
+	EXPECT_EQ(calls2, 10000u);
+	for(int i = 0; i < 10000; i++){
+		EXPECT_EQ(ht.at(key(i)), i);
+	}
+}
+
+// A prober written against the documented init()/next() contract only: the
+// step depends on the key, and keyHash()/initHashed() are left alone
+struct KeyStepProber : public Prober<string> {
+	HASH_INDEX_T step_;
+	void init(HASH_INDEX_T start, HASH_INDEX_T m, const string& key){
+		Prober<string>::init(start, m, key);
+		step_ = 1 + key.size() % 2;
+	}
+	HASH_INDEX_T next(){
+		if(numProbes_ >= m_){
+			return npos;
+		}
+		HASH_INDEX_T loc = (start_ + numProbes_ * step_) % m_;
+		numProbes_++;
+		return loc;
+	}
+};
+
+TEST(HashTable,CustomProberInitOnly){
+	HashTable<string, int, KeyStepProber, MyStringHash, equal_to<> > ht;
+	for(int i = 0; i < 200; i++){
+		ht.insert({key(i), i});
+	}
+	EXPECT_EQ(ht.size(), 200u);
+	for(int i = 0; i < 200; i += 2){
+		ht.remove(key(i));
+	}
+	ht.insert({key(1000), 1000});
+	for(int i = 1; i < 200; i += 2){
+		EXPECT_EQ(ht.at(key(i)), i);
+		EXPECT_EQ(ht.find(key(i - 1)), nullptr);
+	}
+	EXPECT_EQ(ht.at(key(1000)), 1000);
+	EXPECT_EQ(ht.find(string_view(key(7))), ht.find(key(7)));
+}
+
+TEST(HashTable,CachedHashCollision){
+	// MyStringHash ignores case, so these keys collide on the full hash
+	// and must still be told apart by KeyEqual
+	StrTable ht;
+	ht.insert({"abc", 1});
+	ht.insert({"ABC", 2});
+	ht.insert({"aBc", 3});
+	EXPECT_EQ(ht.size(), 3u);
+	EXPECT_EQ(ht.at("abc"), 1);
+	EXPECT_EQ(ht.at("ABC"), 2);
+	EXPECT_EQ(ht.at("aBc"), 3);
+	EXPECT_EQ(ht.find("Abc"), nullptr);
+}
+
+TEST(ConcurrentHashTable,MatchesMap){
+	ConcStrTable ht;
+	map<string, int> ref;
+	mt19937 gen(11);
+	for(int i = 0; i < 20000; i++){
+		string k = key(gen() % 3000);
+		if(gen() % 4 == 0){
+			EXPECT_EQ(ht.remove(k), ref.erase(k) == 1) << k;
+		}
+		else{
+			ht.insert({k, i});
+			ref[k] = i;
+		}
+	}
+	EXPECT_EQ(ht.size(), ref.size());
+	EXPECT_LT(ht.loadFactor(), 0.4);
+	for(int i = 0; i < 3000; i++){
+		int v = -1;
+		map<string, int>::iterator it = ref.find(key(i));
+		EXPECT_EQ(ht.lookup(key(i), v), it != ref.end()) << i;
+		if(it != ref.end()){
+			EXPECT_EQ(v, it->second) << i;
+		}
+	}
+	ht.reclaim();
+	ConcStrTable moved(std::move(ht));
+	EXPECT_EQ(moved.size(), ref.size());
+	EXPECT_EQ(ht.size(), 0u);
+	EXPECT_EQ(ht.find(ref.begin()->first), nullptr);
+	EXPECT_EQ(moved.find(ref.begin()->first)->second, ref.begin()->second);
+}
+
+TEST(ConcurrentHashTable,Reserve){
+	ConcurrentHashTable<int, int> ht(0.5);
+	ht.reserve(1000);
+	size_t cap = ht.capacity();
+	EXPECT_GE(cap * 0.5, 999.0);
+	for(int i = 0; i < 1000; i++){
+		ht.insert({i, i});
+	}
+	EXPECT_EQ(ht.capacity(), cap);
+}
+
+TEST(ConcurrentHashTable,ReadersDuringWrites){
+	// readers look up keys that are always there, with a value a writer
+	// keeps replacing, while other writers insert and remove enough keys to
+	// resize the table many times over
+	const int stable = 500, churn = 20000;
+	ConcStrTable ht;
+	for(int i = 0; i < stable; i++){
+		ht.insert({key(i), 2*i});
+	}
+	atomic<bool> done(false);
+	atomic<int> bad(0);
+	vector<thread> threads;
+	for(int r = 0; r < 3; r++){
+		threads.emplace_back([&, r]{
+			for(int pass = 0; !done.load() || pass < 2; pass++){
+				for(int i = r; i < stable; i += 3){
+					const pair<string, int>* p = ht.find(key(i));
+					if(!p || p->first != key(i) || (p->second != 2*i && p->second != 2*i + 1))
+						bad++;
+				}
+			}
+		});
+	}
+	threads.emplace_back([&]{
+		for(int round = 0; round < 20; round++)
+			for(int i = 0; i < stable; i++)
+				ht.insert({key(i), 2*i + round % 2});
+	});
+	for(int w = 0; w < 2; w++){
+		threads.emplace_back([&, w]{
+			for(int i = stable + w; i < stable + churn; i += 2){
+				ht.insert({key(i), i});
+				if(i % 3 == 0) ht.remove(key(i));
+			}
+		});
+	}
+	for(size_t t = 3; t < threads.size(); t++) threads[t].join();
+	done = true;
+	for(int t = 0; t < 3; t++) threads[t].join();
+	EXPECT_EQ(bad.load(), 0);
+
+	size_t expected = stable;
+	for(int i = stable; i < stable + churn; i++){
+		EXPECT_EQ(ht.contains(key(i)), i % 3 != 0) << i;
+		expected += i % 3 != 0;
+	}
+	EXPECT_EQ(ht.size(), expected);
+	ht.reclaim();
+	for(int i = 0; i < stable; i++){
+		EXPECT_EQ(ht.find(key(i))->second, 2*i + 1) << i;
+	}
+}
+
+TEST(ShardedHashTable,MatchesMap){
+	ShardedStrTable ht(0.4, DoubleHashProber<string, MyStringHash>(), MyStringHash(), equal_to<string>(), 5);
+	EXPECT_EQ(ht.shardCount(), 8u);
+	map<string, int> ref;
+	mt19937 gen(13);
+	for(int i = 0; i < 20000; i++){
+		string k = key(gen() % 3000);
+		if(gen() % 4 == 0){
+			ht.remove(k);
+			ref.erase(k);
+		}
+		else{
+			ht.insert({k, i});
+			ref[k] = i;
+		}
+	}
+	EXPECT_EQ(ht.size(), ref.size());
+	for(int i = 0; i < 3000; i++){
+		int v = -1;
+		map<string, int>::iterator it = ref.find(key(i));
+		EXPECT_EQ(ht.lookup(key(i), v), it != ref.end()) << i;
+		if(it != ref.end()){
+			EXPECT_EQ(v, it->second) << i;
+			EXPECT_TRUE(ht.shard(ht.shardOf(key(i))).find(key(i)) != nullptr) << i;
+		}
+	}
+	// every shard gets a fair share
+	for(size_t s = 0; s < ht.shardCount(); s++){
+		EXPECT_GT(ht.shard(s).size(), ref.size() / 16) << s;
+	}
+}
+
+TEST(ShardedHashTable,InsertBatch){
+	vector<pair<string, int> > items;
+	for(int i = 0; i < 50000; i++){
+		items.push_back({key(i), i});
+	}
+	ShardedStrTable ht;
+	ht.insert({key(3), -3});
+	ht.insert({"other", 1});
+	ht.insertBatch(items.data(), items.size(), 4);
+	EXPECT_EQ(ht.size(), 50001u);
+	for(int i = 0; i < 50000; i++){
+		int v = -1;
+		EXPECT_TRUE(ht.lookup(key(i), v)) << i;
+		EXPECT_EQ(v, i);
+	}
+	EXPECT_TRUE(ht.contains("other"));
+	// each shard was sized once for its share, below alpha
+	for(size_t s = 0; s < ht.shardCount(); s++){
+		EXPECT_LT(ht.shard(s).loadFactor(), 0.4) << s;
+		EXPECT_EQ(ht.shard(s).stats().resizes, 1u) << s;
+	}
+}
+
+TEST(ShardedHashTable,ConcurrentWriters){
+	ShardedStrTable ht;
+	vector<thread> threads;
+	for(int t = 0; t < 4; t++){
+		threads.emplace_back([&, t]{
+			for(int i = t; i < 20000; i += 4){
+				ht.insert({key(i), i});
+				if(i % 5 == 0) ht.remove(key(i));
+			}
+		});
+	}
+	for(thread& th : threads) th.join();
+	EXPECT_EQ(ht.size(), 16000u);
+	for(int i = 0; i < 20000; i++){
+		EXPECT_EQ(ht.contains(key(i)), i % 5 != 0) << i;
+	}
+}
+
+// std::allocator that counts what it hands out and takes back
+static size_t allocated = 0, deallocated = 0;
+template <typename T>
+struct CountingAllocator : std::allocator<T> {
+	typedef T value_type;
+	CountingAllocator() {}
+	template <typename U> CountingAllocator(const CountingAllocator<U>&) {}
+	template <typename U> struct rebind { typedef CountingAllocator<U> other; };
+	T* allocate(size_t n){ allocated += n; return std::allocator<T>::allocate(n); }
+	void deallocate(T* p, size_t n){ deallocated += n; std::allocator<T>::deallocate(p, n); }
+};
+
+TEST(HashTable,Allocator){
+	allocated = deallocated = 0;
+	{
+		HashTable<string, int, LinearProber<string>, hash<string>, equal_to<string>,
+			CountingAllocator<pair<string, int> > > ht;
+		for(int i = 0; i < 100; i++){
+			ht.insert({key(i), i});
+		}
+		EXPECT_EQ(allocated, 100u);
+		for(int i = 0; i < 30; i++){
+			ht.remove(key(i));
+		}
+		ht.rehash();
+		EXPECT_EQ(deallocated, 30u);
+		decltype(ht) copy(ht);
+		EXPECT_EQ(allocated, 170u);
+	}
+	EXPECT_EQ(deallocated, 170u);
+}
+
+typedef HashTable<ArenaString, int, DoubleHashProber<ArenaString, MyStringHash>, MyStringHash,
+	equal_to<ArenaString>, ArenaAllocator<pair<ArenaString, int> > > ArenaTable;
+
+TEST(HashTable,Arena){
+	static_assert(SkipItemDestroy<ArenaTable::AllocatorType, ArenaTable::ItemType>::value,
+		"arena strings and ints need no destructor");
+	static_assert(!SkipItemDestroy<ArenaAllocator<int>, pair<string, int> >::value,
+		"std::string keys own heap memory");
+	static_assert(!SkipItemDestroy<allocator<int>, pair<int, int> >::value,
+		"std::allocator frees item by item");
+
+	Arena arena;
+	ArenaAllocator<char> alloc(&arena);
+	// long keys, so their bytes cannot sit inside the string object
+	vector<string> keys;
+	for(int i = 0; i < 10000; i++){
+		keys.push_back(key(i) + "-long-enough-for-the-heap");
+	}
+	{
+		ArenaTable ht(0.4, DoubleHashProber<ArenaString, MyStringHash>(), MyStringHash(),
+			equal_to<ArenaString>(), ArenaTable::AllocatorType(&arena));
+		EXPECT_EQ(ht.get_allocator().arena(), &arena);
+		for(int i = 0; i < 10000; i++){
+			ht.insert({ArenaString(keys[i].c_str(), alloc), i});
+		}
+		for(int i = 0; i < 10000; i += 2){
+			ht.remove(ArenaString(keys[i].c_str(), alloc));
+		}
+		EXPECT_EQ(ht.size(), 5000u);
+		ArenaTable copy(ht);
+		for(int i = 0; i < 10000; i++){
+			const pair<ArenaString, int>* p = copy.find(ArenaString(keys[i].c_str(), alloc));
+			EXPECT_EQ(p != nullptr, i % 2 == 1) << i;
+			if(p){
+				EXPECT_EQ(p->second, i);
+				EXPECT_EQ(p->first.get_allocator(), alloc);
+			}
+		}
+	}
+	// items, copies and key bytes: a few large slabs instead of 60000
+	// separate allocations
+	EXPECT_GT(arena.bytesAllocated(), 20000 * sizeof(ArenaTable::HashItem));
+	EXPECT_LT(arena.slabs(), 20u);
+}
+
+typedef HashTable<string, int, DoubleHashProber<string, MyStringHash>, MyStringHash, equal_to<> > ViewTable;
+
+TEST(HashTable,StringViewLookup){
+	ViewTable ht;
+	string text;
+	vector<size_t> starts;
+	for(int i = 0; i < 1000; i++){
+		ht.insert({key(i), i});
+		starts.push_back(text.size());
+		text += key(i);
+	}
+	starts.push_back(text.size());
+	// slices of one buffer, none of them a string of its own
+	for(int i = 0; i < 1000; i++){
+		string_view k(text.data() + starts[i], starts[i + 1] - starts[i]);
+		const pair<string, int>* p = ht.find(k);
+		ASSERT_NE(p, nullptr) << k;
+		EXPECT_EQ(p->second, i);
+		EXPECT_EQ(ht.at(k), i);
+		EXPECT_EQ(ht[k], i);
+	}
+	EXPECT_EQ(ht.find(string_view(text.data(), starts[2] - 1)), nullptr);
+	EXPECT_THROW(ht.at(string_view("missing")), std::out_of_range);
+	EXPECT_EQ(ht.find("key5") != nullptr, ht.find(string("key5")) != nullptr);
+	for(int i = 0; i < 1000; i += 2){
+		ht.remove(string_view(text.data() + starts[i], starts[i + 1] - starts[i]));
+	}
+	EXPECT_EQ(ht.size(), 500u);
+	for(int i = 0; i < 1000; i++){
+		EXPECT_EQ(ht.find(key(i)) != nullptr, i % 2 == 1) << i;
+	}
+	const ViewTable& cht = ht;
+	EXPECT_EQ(cht.at(string_view(key(1))), 1);
+	HASH_INDEX_T h = cht.hasher()(string_view("key3"));
+	EXPECT_EQ(h, cht.hasher()(string("key3")));
+}
+
+TEST(HashTable,StringViewLookupAllocatesNothing){
+	typedef HashTable<ArenaString, int, DoubleHashProber<ArenaString, MyStringHash>, MyStringHash,
+		equal_to<>, ArenaAllocator<pair<ArenaString, int> > > ArenaViewTable;
+	Arena arena;
+	ArenaAllocator<char> alloc(&arena);
+	ArenaViewTable ht(0.4, DoubleHashProber<ArenaString, MyStringHash>(), MyStringHash(),
+		equal_to<>(), ArenaViewTable::AllocatorType(&arena));
+	vector<string> keys;
+	for(int i = 0; i < 1000; i++){
+		keys.push_back(key(i) + "-long-enough-for-the-heap");
+		ht.insert({ArenaString(keys[i].c_str(), alloc), i});
+	}
+	size_t before = arena.bytesAllocated();
+	for(int i = 0; i < 1000; i++){
+		EXPECT_EQ(ht.at(string_view(keys[i])), i);
+		EXPECT_EQ(ht.find(string_view(keys[i] + "x")), nullptr);
+	}
+	EXPECT_EQ(arena.bytesAllocated(), before);
+}
+
+// a value that counts its copies and refuses to be copied silently
+struct Postings {
+	static int copies;
+	vector<int> ids;
+	Postings(){}
+	explicit Postings(int n) : ids(n, n) {}
+	Postings(const Postings& other) : ids(other.ids) { copies++; }
+	Postings(Postings&&) = default;
+	Postings& operator=(const Postings& other){ ids = other.ids; copies++; return *this; }
+	Postings& operator=(Postings&&) = default;
+};
+int Postings::copies = 0;
+
+TEST(HashTable,MoveAndEmplace){
+	Postings::copies = 0;
+	HashTable<string, Postings, DoubleHashProber<string, MyStringHash>, MyStringHash> ht;
+	// enough items for several resizes
+	for(int i = 0; i < 3000; i++){
+		switch(i % 4){
+		case 0: ht.insert(make_pair(key(i), Postings(i))); break;
+		case 1: EXPECT_TRUE(ht.emplace(key(i), Postings(i)).second); break;
+		case 2: EXPECT_TRUE(ht.try_emplace(key(i), i).second); break;
+		default: EXPECT_TRUE(ht.insert_or_assign(key(i), Postings(i)).second); break;
+		}
+	}
+	EXPECT_EQ(ht.size(), 3000u);
+	EXPECT_EQ(Postings::copies, 0);
+
+	// existing keys: emplace and try_emplace leave the item alone, insert
+	// and insert_or_assign move the new value in
+	Postings big(7);
+	auto r = ht.try_emplace(key(5), std::move(big));
+	EXPECT_FALSE(r.second);
+	EXPECT_EQ(r.first->second.ids.size(), 5u);
+	EXPECT_EQ(big.ids.size(), 7u);
+	r = ht.emplace(key(5), Postings(8));
+	EXPECT_FALSE(r.second);
+	EXPECT_EQ(r.first->second.ids.size(), 5u);
+	r = ht.insert_or_assign(key(5), Postings(9));
+	EXPECT_FALSE(r.second);
+	EXPECT_EQ(ht.at(key(5)).ids.size(), 9u);
+	ht.insert(make_pair(key(5), Postings(10)));
+	EXPECT_EQ(ht.at(key(5)).ids.size(), 10u);
+	EXPECT_EQ(Postings::copies, 0);
+
+	for(int i = 0; i < 3000; i++){
+		if(i != 5){
+			EXPECT_EQ(ht.at(key(i)).ids.size(), size_t(i)) << i;
+		}
+	}
+	ht.insert_or_assign(key(5), big);
+	EXPECT_EQ(Postings::copies, 1);
+}
+
+template <typename Table, typename Key>
+static void robinHoodMatchesMap(Key (*makeKey)(int))
+{
+	Table ht(0.9);
+	map<Key, int> ref;
+	mt19937 rng(7);
+	for(int step = 0; step < 60000; step++){
+		Key k = makeKey(rng() % 5000);
+		if(rng() % 3 == 0){
+			ht.remove(k);
+			ref.erase(k);
+		}
+		else{
+			ht.insert({k, step});
+			ref[k] = step;
+		}
+	}
+	ASSERT_EQ(ht.size(), ref.size());
+	EXPECT_EQ(ht.tombstones(), 0u);
+	for(int i = 0; i < 5000; i++){
+		Key k = makeKey(i);
+		auto it = ref.find(k);
+		const pair<Key, int>* p = ht.find(k);
+		ASSERT_EQ(p != nullptr, it != ref.end()) << i;
+		if(p){
+			EXPECT_EQ(p->second, it->second);
+		}
+	}
+}
+
+static string strKey(int i){ return key(i); }
+static int intKey(int i){ return i * 7919; }
+
+TEST(HashTable,RobinHoodMatchesMap){
+	robinHoodMatchesMap<HashTable<string, int, RobinHoodProber<string>, MyStringHash> >(strKey);
+	robinHoodMatchesMap<HashTable<string, int, RobinHoodProber<string, PowerOfTwoCapacity>, MyStringHash> >(strKey);
+	// no cached hashes: item homes come from hashing the key again
+	robinHoodMatchesMap<HashTable<int, int, RobinHoodProber<int> > >(intKey);
+	robinHoodMatchesMap<HashTable<int, int, RobinHoodProber<int, PowerOfTwoCapacity> > >(intKey);
+}
+
+TEST(HashTable,RobinHoodDense){
+	HashTable<string, int, LinearProber<string>, MyStringHash> linear(0.9);
+	HashTable<string, int, RobinHoodProber<string>, MyStringHash> robin(0.9);
+	for(int i = 0; i < 20000; i++){
+		linear.insert({key(i), i});
+		robin.insert({key(i), i});
+	}
+	EXPECT_EQ(robin.capacity(), linear.capacity());
+	// churn at a steady size leaves no tombstones and never grows the table
+	size_t capacity = robin.capacity();
+	for(int i = 0; i < 20000; i++){
+		robin.remove(key(i));
+		robin.insert({key(i + 20000), i});
+	}
+	EXPECT_EQ(robin.capacity(), capacity);
+	EXPECT_EQ(robin.tombstones(), 0u);
+	EXPECT_EQ(robin.size(), 20000u);
+
+	linear.clearStats();
+	robin.clearStats();
+	for(int i = 0; i < 20000; i++){
+		EXPECT_EQ(robin.at(key(i + 20000)), i);
+		EXPECT_EQ(robin.find(key(i + 40000)), nullptr);
+		linear.find(key(i));
+		linear.find(key(i + 40000));
+	}
+	// misses stop early and probe lengths spread far less
+	EXPECT_LT(robin.stats().meanProbe(HashTableStats::MISS), linear.stats().meanProbe(HashTableStats::MISS));
+	EXPECT_LT(robin.stats().maxProbe[HashTableStats::HIT], linear.stats().maxProbe[HashTableStats::HIT]);
+}
+
+template <typename Table, typename Key>
+static void incrementalMatchesMap(Key (*makeKey)(int))
+{
+	Table ht;
+	ht.setIncrementalResize(4);
+	map<Key, int> ref;
+	mt19937 rng(11);
+	bool sawResize = false;
+	for(int step = 0; step < 40000; step++){
+		Key k = makeKey(rng() % 20000);
+		switch(rng() % 4){
+		case 0:
+			ht.remove(k);
+			ref.erase(k);
+			break;
+		case 1: {
+			const pair<Key, int>* p = ht.find(k);
+			auto it = ref.find(k);
+			ASSERT_EQ(p != nullptr, it != ref.end()) << step;
+			if(p){
+				ASSERT_EQ(p->second, it->second) << step;
+			}
+			break;
+		}
+		default:
+			ht.insert({k, step});
+			ref[k] = step;
+		}
+		sawResize = sawResize || ht.resizing();
+		if(step == 20000 && ht.resizing()){
+			// a copy mid-resize looks up the same
+			Table copy(ht);
+			for(const auto& kv : ref){
+				ASSERT_NE(copy.find(kv.first), nullptr);
+			}
+		}
+	}
+	EXPECT_TRUE(sawResize);
+	ASSERT_EQ(ht.size(), ref.size());
+	ht.finishResize();
+	EXPECT_FALSE(ht.resizing());
+	ASSERT_EQ(ht.size(), ref.size());
+	for(const auto& kv : ref){
+		EXPECT_EQ(ht.at(kv.first), kv.second);
+	}
+}
+
+TEST(HashTable,IncrementalResizeMatchesMap){
+	incrementalMatchesMap<StrTable>(strKey);
+	incrementalMatchesMap<HashTable<string, int, RobinHoodProber<string>, MyStringHash> >(strKey);
+	incrementalMatchesMap<HashTable<int, int, LinearProber<int> > >(intKey);
+	incrementalMatchesMap<HashTable<int, int, RobinHoodProber<int, PowerOfTwoCapacity> > >(intKey);
+}
+
+TEST(HashTable,IncrementalResize){
+	StrTable eager, lazy;
+	lazy.setIncrementalResize(3);
+	size_t resizes = 0;
+	for(int i = 0; i < 50000; i++){
+		eager.insert({key(i), i});
+		bool was = lazy.resizing();
+		lazy.insert({key(i), i});
+		if(!was && lazy.resizing()){
+			resizes++;
+			// the old buckets hold everything but the new key
+			EXPECT_EQ(lazy.at(key(0)), 0);
+			EXPECT_EQ(lazy.at(key(i)), i);
+		}
+		// every resize is done before the next one is due
+		EXPECT_EQ(lazy.capacity(), eager.capacity()) << i;
+	}
+	EXPECT_EQ(resizes, eager.stats().resizes);
+	EXPECT_EQ(resizes, lazy.stats().resizes);
+	for(int i = 0; i < 50000; i++){
+		EXPECT_EQ(lazy.at(key(i)), i);
+	}
+	lazy.reserve(200000);
+	EXPECT_FALSE(lazy.resizing());
+	EXPECT_EQ(lazy.size(), 50000u);
+	EXPECT_EQ(lazy.tombstones(), 0u);
+}
+
+// every key of a snapshot of ht maps back to its value, and nothing else
+template <typename Table, typename Mapped>
+static void expectSnapshotMatches(const Table& ht, const Mapped& snap, int n)
+{
+	EXPECT_EQ(snap.size(), ht.size());
+	EXPECT_EQ(snap.capacity(), ht.capacity());
+	for(int i = 0; i < n; i++){
+		string k = key(i);
+		const auto* p = ht.find(k);
+		const int* v = snap.find(k);
+		ASSERT_EQ(v != nullptr, p != nullptr) << i;
+		if(v){
+			EXPECT_EQ(*v, p->second);
+		}
+		EXPECT_EQ(snap.find(k + "-missing"), nullptr);
+	}
+}
+
+TEST(HashTable,Snapshot){
+	const char* fname = "ht-check-snapshot.bin";
+	StrTable ht;
+	for(int i = 0; i < 5000; i++){
+		ht.insert({key(i), i});
+	}
+	// tombstones keep later probe sequences intact
+	for(int i = 0; i < 5000; i += 3){
+		ht.remove(key(i));
+	}
+	saveSnapshot(ht, fname);
+	{
+		MappedHashTable<int> snap(fname, ht.hasher(), ht.prober());
+		expectSnapshotMatches(ht, snap, 5000);
+		EXPECT_EQ(snap.at("key1"), 1);
+		EXPECT_EQ(snap.findByHash(ht.hasher()(string("key2")), "key2"), &snap["key2"]);
+		EXPECT_THROW(snap.at("key0"), std::out_of_range);
+		MappedHashTable<int> moved(std::move(snap));
+		EXPECT_EQ(moved["key4"], 4);
+	}
+
+	// random seeds: taken from the file, or checked against the caller's
+	StrTable seeded(0.4, DoubleHashProber<string, MyStringHash>(MyStringHash(false)), MyStringHash(false));
+	for(int i = 0; i < 1000; i++){
+		seeded.insert({key(i), i});
+	}
+	saveSnapshot(seeded, fname);
+	{
+		MappedHashTable<int> snap(fname);
+		EXPECT_EQ(snap.hasher().rValues[2], seeded.hasher().rValues[2]);
+		expectSnapshotMatches(seeded, snap, 1000);
+	}
+	EXPECT_THROW(MappedHashTable<int>(fname, MyStringHash()), std::invalid_argument);
+	EXPECT_THROW(MappedHashTable<int>(fname, seeded.hasher()), std::invalid_argument);
+	MappedHashTable<int>(fname, seeded.hasher(), seeded.prober());
+	// another prober or value type cannot read it
+	typedef MappedHashTable<int, LinearProber<string> > LinearSnapshot;
+	EXPECT_THROW(LinearSnapshot{fname}, std::invalid_argument);
+	EXPECT_THROW(MappedHashTable<long long>{fname}, std::invalid_argument);
+	remove(fname);
+	EXPECT_THROW(MappedHashTable<int>("dict.txt"), std::invalid_argument);
+	EXPECT_THROW(MappedHashTable<int>{fname}, std::invalid_argument);
+}
+
+TEST(HashTable,SnapshotRejectsCorruption){
+	const char* fname = "ht-check-snapshot.bin";
+	typedef SnapshotSlot<int> Slot;
+	StrTable ht;
+	for(int i = 0; i < 100; i++){
+		ht.insert({key(i), i});
+	}
+	ht.remove(key(7));
+	saveSnapshot(ht, fname);
+	string bytes;
+	{
+		ifstream in(fname, ios::binary);
+		bytes.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	}
+	size_t full = sizeof(SnapshotHeader);
+	while(reinterpret_cast<const Slot*>(&bytes[full])->state != Slot::FULL){
+		full += sizeof(Slot);
+	}
+	auto rejects = [&](const string& bad){
+		ofstream(fname, ios::binary) << bad;
+		EXPECT_THROW(MappedHashTable<int>{fname}, std::invalid_argument);
+	};
+	auto patch = [&](size_t at, auto value){
+		string bad = bytes;
+		memcpy(&bad[at], &value, sizeof(value));
+		rejects(bad);
+	};
+	rejects(bytes.substr(0, bytes.size() - 1));
+	rejects(bytes + "x");
+	patch(offsetof(SnapshotHeader, poolSize), ~uint64_t(0));
+	patch(offsetof(SnapshotHeader, buckets), uint64_t(1) << 62);
+	patch(offsetof(SnapshotHeader, count), uint64_t(101));
+	patch(full + offsetof(Slot, state), uint32_t(7));
+	patch(full + offsetof(Slot, keyOffset), uint64_t(bytes.size()));
+	patch(full + offsetof(Slot, keyOffset), ~uint64_t(0));
+	patch(full + offsetof(Slot, keyLength), uint32_t(0xFFFFFFFF));
+
+	ofstream(fname, ios::binary) << bytes;
+	MappedHashTable<int> snap{fname};
+	EXPECT_EQ(snap.size(), 99u);
+	remove(fname);
+}
+
+TEST(HashTable,SnapshotProbers){
+	const char* fname = "ht-check-snapshot.bin";
+	HashTable<string, int, RobinHoodProber<string, PowerOfTwoCapacity>, MyStringHash> robin(0.9);
+	// arena keys are saved like any other string
+	Arena a;
+	ArenaAllocator<char> alloc(&a);
+	HashTable<ArenaString, int, LinearProber<ArenaString>, MyStringHash,
+		equal_to<ArenaString>, ArenaAllocator<pair<ArenaString, int> > > arena(0.5,
+		LinearProber<ArenaString>(), MyStringHash(), equal_to<ArenaString>(),
+		ArenaAllocator<pair<ArenaString, int> >(&a));
+	for(int i = 0; i < 3000; i++){
+		robin.insert({key(i), i});
+		arena.insert({ArenaString(key(i).c_str(), alloc), i});
+	}
+	for(int i = 0; i < 3000; i += 4){
+		robin.remove(key(i));
+	}
+	saveSnapshot(robin, fname);
+	{
+		MappedHashTable<int, RobinHoodProber<string, PowerOfTwoCapacity> > snap(fname);
+		expectSnapshotMatches(robin, snap, 3000);
+	}
+	saveSnapshot(arena, fname);
+	{
+		MappedHashTable<int, LinearProber<string> > snap(fname);
+		EXPECT_EQ(snap.size(), 3000u);
+		for(int i = 0; i < 3000; i++){
+			EXPECT_EQ(snap.at(key(i)), i);
+		}
+	}
+	remove(fname);
+
+	StrTable lazy;
+	lazy.setIncrementalResize(2);
+	for(int i = 0; i < 12; i++){
+		lazy.insert({key(i), i});
+	}
+	ASSERT_TRUE(lazy.resizing());
+	EXPECT_THROW(saveSnapshot(lazy, fname), std::logic_error);
+}
@@ -0,0 +1,476 @@
+//
+// HashTable throughput and latency benchmarks (Google Benchmark)
+//
+// Every benchmark is run for each table type (LinearProber, DoubleHashProber,
+// RobinHoodProber, DoubleHashProber with incremental resizing,
+// std::unordered_map) at each key count and load factor:
+//   Insert  fill an empty table with n keys
+//   Hit     find each of the n keys, in an order unrelated to insertion
+//   Miss    find n keys that are not in the table
+//   Remove  remove every key from a full table
+//   InsertBatch  insertBatch() of all n keys into an empty table, for
+//           HashTable and for ShardedHashTable on every core
+//   Build   fill a table and destroy it, with std::string keys on the heap
+//           or ArenaString keys and items in an Arena
+//   Hash    hash each key (MyStringHash vs std::hash)
+//
+// Keys are the words of dict.txt in a fixed shuffled order, followed by
+// synthetic keys once the dictionary runs out. Synthetic keys end in a
+// digit so they never equal a dictionary word; misses end in another one.
+//
+// The load argument is the load factor n / capacity every table runs at,
+// not just the limit it grows by: the keys argument picks the capacity (the
+// one the table grows into for that many keys), and the table then gets as
+// many keys as fill that capacity to the load asked for. The n counter is
+// that key count and load the load the table reached.
+//
+// items_per_second is the throughput of the timed loop. p50_ns, p99_ns and
+// max_ns come from a separate pass that times single operations (minus the
+// cost of reading the clock), so they do not slow the throughput numbers
+// down. max_ns is where a resize shows up.
+//
+//   ./ht-perf [--max-keys=N] [--dict=file] [benchmark options]
+//   ./ht-perf --benchmark_filter=Hit --benchmark_format=json
+//
+// --max-keys (default 1000000) caps the key counts; pass 10000000 for the
+// full 1k..10M sweep. make run-ht-perf writes the whole sweep to
+// ht-perf.json.
+//
+#include "ht.h"
+#include "sharded-ht.h"
+#include "arena.h"
+#include "hash.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+typedef HashTable<string, int, LinearProber<string>, MyStringHash> LinearTable;
+typedef HashTable<string, int, DoubleHashProber<string, MyStringHash>, MyStringHash> DoubleTable;
+typedef HashTable<string, int, RobinHoodProber<string>, MyStringHash> RobinHoodTable;
+typedef unordered_map<string, int> StdMap;
+// DoubleTable resizing a few buckets per insert instead of all at once
+struct IncrementalTable : DoubleTable {
+    explicit IncrementalTable(double alpha) : DoubleTable(alpha) { setIncrementalResize(8); }
+};
+typedef ShardedHashTable<string, int, DoubleHashProber<string, MyStringHash>, MyStringHash> ShardedTable;
+typedef HashTable<ArenaString, int, DoubleHashProber<ArenaString, MyStringHash>, MyStringHash,
+                  equal_to<ArenaString>, ArenaAllocator<pair<ArenaString, int> > > ArenaTable;
+
+static const uint32_t KEY_SEED = 20240601;
+static const size_t MAX_SAMPLES = 1 << 16;
+
+// ----- Keys -----
+
+static string dictFile = "dict.txt";
+
+// 64 bits of i, scrambled (odd multiplier, so distinct i stay distinct) and
+// spelled in base 26, then tagged with a digit
+static string synthetic(uint64_t i, char tag)
+{
+    uint64_t x = (i + 1) * 0x9E3779B97F4A7C15ULL;
+    string s;
+    do {
+        s += char('a' + x % 26);
+        x /= 26;
+    } while (x);
+    s += tag;
+    return s;
+}
+
+// The first n keys; one vector grows to the largest n asked for, so every
+// benchmark with the same n sees the same keys.
+static const vector<string>& keys(size_t n)
+{
+    static vector<string> all;
+    static bool loaded = false;
+    if (!loaded) {
+        ifstream in(dictFile.c_str());
+        string w;
+        while (in >> w) all.push_back(w);
+        if (all.empty())
+            cerr << "ht-perf: no words in " << dictFile << ", using synthetic keys only" << endl;
+        shuffle(all.begin(), all.end(), mt19937(KEY_SEED));
+        loaded = true;
+    }
+    all.reserve(n);
+    for (size_t i = all.size(); i < n; ++i)
+        all.push_back(synthetic(i, '0'));
+    return all;
+}
+
+static vector<string> misses(size_t n)
+{
+    vector<string> out(n);
+    for (size_t i = 0; i < n; ++i)
+        out[i] = synthetic(i, '1');
+    return out;
+}
+
+// a lookup order unrelated to the insertion (and allocation) order
+static vector<uint32_t> permutation(size_t n)
+{
+    vector<uint32_t> p(n);
+    for (size_t i = 0; i < n; ++i) p[i] = uint32_t(i);
+    shuffle(p.begin(), p.end(), mt19937(KEY_SEED + 1));
+    return p;
+}
+
+// ----- Table adapters -----
+
+template<typename Table>
+struct Ops {
+    static Table* make(double alpha) { return new Table(alpha); }
+    static void insert(Table& t, const string& k, int v) { t.insert(make_pair(k, v)); }
+    static bool find(const Table& t, const string& k) { return t.find(k) != nullptr; }
+    static void remove(Table& t, const string& k) { t.remove(k); }
+    static double load(const Table& t) { return double(t.size()) / t.capacity(); }
+    // the capacity an empty table grows to while n keys go in; reserve()
+    // grows by the same rule, and allocates only the bucket array
+    static size_t capacityFor(size_t n, double alpha)
+    {
+        Table t(alpha);
+        t.reserve(n);
+        return t.capacity();
+    }
+    // the most keys capacityFor(n, alpha) holds without growing
+    static size_t fullAt(size_t capacity, double alpha) { return size_t(capacity * alpha); }
+};
+
+template<>
+struct Ops<StdMap> {
+    static StdMap* make(double alpha)
+    {
+        StdMap* t = new StdMap;
+        t->max_load_factor(float(alpha));
+        return t;
+    }
+    static void insert(StdMap& t, const string& k, int v) { t.insert(make_pair(k, v)); }
+    static bool find(const StdMap& t, const string& k) { return t.find(k) != t.end(); }
+    static void remove(StdMap& t, const string& k) { t.erase(k); }
+    static double load(const StdMap& t) { return t.load_factor(); }
+    // unordered_map grows in its own steps, and reserve() skips some of
+    // them, so count the buckets of a real fill; the key type does not
+    // change the growth policy
+    static size_t capacityFor(size_t n, double alpha)
+    {
+        unordered_map<size_t, char> t;
+        t.max_load_factor(float(alpha));
+        for (size_t i = 0; i < n; ++i) t.emplace(i, 0);
+        return t.bucket_count();
+    }
+    // it grows once size() would pass buckets * max_load_factor(), which
+    // is a float
+    static size_t fullAt(size_t capacity, double alpha) { return size_t(capacity * double(float(alpha))); }
+};
+
+// ----- Latency -----
+
+typedef chrono::steady_clock Clock;
+
+// cost of one pair of clock reads, taken off every sample
+static double clockOverhead()
+{
+    static double overhead = -1;
+    if (overhead < 0) {
+        vector<double> d(1001);
+        for (size_t i = 0; i < d.size(); ++i) {
+            Clock::time_point a = Clock::now();
+            Clock::time_point b = Clock::now();
+            d[i] = chrono::duration<double, nano>(b - a).count();
+        }
+        nth_element(d.begin(), d.begin() + d.size() / 2, d.end());
+        overhead = d[d.size() / 2];
+    }
+    return overhead;
+}
+
+// Times op(i) for every stride-th i < n and stores p50/p99/max in the
+// counters.
+// op runs for all i, timed or not, so the table follows the same sequence
+// of states as in the timed loop.
+template<typename Op>
+static void latency(benchmark::State& state, size_t n, Op op)
+{
+    size_t stride = n > MAX_SAMPLES ? n / MAX_SAMPLES : 1;
+    double overhead = clockOverhead();
+    vector<double> samples;
+    samples.reserve(n / stride + 1);
+    for (size_t i = 0; i < n; ++i) {
+        if (i % stride) { op(i); continue; }
+        Clock::time_point a = Clock::now();
+        op(i);
+        Clock::time_point b = Clock::now();
+        samples.push_back(max(0.0, chrono::duration<double, nano>(b - a).count() - overhead));
+    }
+    sort(samples.begin(), samples.end());
+    state.counters["p50_ns"] = samples[samples.size() / 2];
+    state.counters["p99_ns"] = samples[samples.size() * 99 / 100];
+    state.counters["max_ns"] = samples.back();
+}
+
+// ----- Benchmarks -----
+// state.range(0) is the key count, state.range(1) the load factor in percent
+
+static double alphaOf(const benchmark::State& state) { return state.range(1) / 100.0; }
+
+// The number of keys that fills the capacity Table grows into for
+// state.range(0) keys to the load factor state.range(1). Without this the
+// load of each table is wherever n happens to fall between two capacities,
+// whatever load the benchmark asked for.
+template<typename Table>
+static size_t keyCount(benchmark::State& state)
+{
+    double alpha = alphaOf(state);
+    size_t n = Ops<Table>::fullAt(Ops<Table>::capacityFor(state.range(0), alpha), alpha);
+    state.counters["n"] = double(n);
+    return n;
+}
+
+template<typename Table>
+static Table* filled(const vector<string>& k, size_t n, double alpha)
+{
+    Table* t = Ops<Table>::make(alpha);
+    for (size_t i = 0; i < n; ++i) Ops<Table>::insert(*t, k[i], int(i));
+    return t;
+}
+
+template<typename Table>
+static void BM_Insert(benchmark::State& state)
+{
+    size_t n = keyCount<Table>(state);
+    const vector<string>& k = keys(n);
+    double load = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        Table* t = Ops<Table>::make(alphaOf(state));
+        state.ResumeTiming();
+        for (size_t i = 0; i < n; ++i) Ops<Table>::insert(*t, k[i], int(i));
+        state.PauseTiming();
+        load = Ops<Table>::load(*t);
+        delete t;
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    state.counters["load"] = load;
+
+    Table* t = Ops<Table>::make(alphaOf(state));
+    latency(state, n, [&](size_t i) { Ops<Table>::insert(*t, k[i], int(i)); });
+    delete t;
+}
+
+template<typename Table>
+static void BM_Hit(benchmark::State& state)
+{
+    size_t n = keyCount<Table>(state);
+    const vector<string>& k = keys(n);
+    vector<uint32_t> order = permutation(n);
+    Table* t = filled<Table>(k, n, alphaOf(state));
+    for (auto _ : state) {
+        size_t found = 0;
+        for (size_t i = 0; i < n; ++i) found += Ops<Table>::find(*t, k[order[i]]);
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    state.counters["load"] = Ops<Table>::load(*t);
+    latency(state, n, [&](size_t i) { benchmark::DoNotOptimize(Ops<Table>::find(*t, k[order[i]])); });
+    delete t;
+}
+
+template<typename Table>
+static void BM_Miss(benchmark::State& state)
+{
+    size_t n = keyCount<Table>(state);
+    const vector<string>& k = keys(n);
+    vector<string> absent = misses(n);
+    Table* t = filled<Table>(k, n, alphaOf(state));
+    for (auto _ : state) {
+        size_t found = 0;
+        for (size_t i = 0; i < n; ++i) found += Ops<Table>::find(*t, absent[i]);
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    state.counters["load"] = Ops<Table>::load(*t);
+    latency(state, n, [&](size_t i) { benchmark::DoNotOptimize(Ops<Table>::find(*t, absent[i])); });
+    delete t;
+}
+
+template<typename Table>
+static void BM_Remove(benchmark::State& state)
+{
+    size_t n = keyCount<Table>(state);
+    const vector<string>& k = keys(n);
+    vector<uint32_t> order = permutation(n);
+    double load = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        Table* t = filled<Table>(k, n, alphaOf(state));
+        load = Ops<Table>::load(*t);
+        state.ResumeTiming();
+        for (size_t i = 0; i < n; ++i) Ops<Table>::remove(*t, k[order[i]]);
+        state.PauseTiming();
+        delete t;
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    state.counters["load"] = load;
+
+    Table* t = filled<Table>(k, n, alphaOf(state));
+    latency(state, n, [&](size_t i) { Ops<Table>::remove(*t, k[order[i]]); });
+    delete t;
+}
+
+static void insertBatch(DoubleTable& t, const vector<pair<string, int> >& items)
+{
+    t.insertBatch(items.data(), items.size());
+}
+
+static void insertBatch(ShardedTable& t, const vector<pair<string, int> >& items)
+{
+    t.insertBatch(items.data(), items.size(), 0);
+}
+
+template<typename Table>
+static void BM_InsertBatch(benchmark::State& state)
+{
+    size_t n = state.range(0);
+    const vector<string>& k = keys(n);
+    vector<pair<string, int> > items(n);
+    for (size_t i = 0; i < n; ++i) items[i] = make_pair(k[i], int(i));
+    for (auto _ : state) {
+        state.PauseTiming();
+        Table* t = new Table(alphaOf(state));
+        state.ResumeTiming();
+        insertBatch(*t, items);
+        state.PauseTiming();
+        delete t;
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void BM_BuildHeap(benchmark::State& state)
+{
+    size_t n = state.range(0);
+    const vector<string>& k = keys(n);
+    for (auto _ : state) {
+        DoubleTable t(alphaOf(state));
+        for (size_t i = 0; i < n; ++i) t.insert(make_pair(k[i], int(i)));
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void BM_BuildArena(benchmark::State& state)
+{
+    size_t n = state.range(0);
+    const vector<string>& k = keys(n);
+    for (auto _ : state) {
+        Arena arena;
+        ArenaAllocator<char> alloc(&arena);
+        ArenaTable t(alphaOf(state), DoubleHashProber<ArenaString, MyStringHash>(), MyStringHash(),
+                     equal_to<ArenaString>(), ArenaTable::AllocatorType(&arena));
+        for (size_t i = 0; i < n; ++i) t.insert(make_pair(ArenaString(k[i].c_str(), k[i].size(), alloc), int(i)));
+        state.counters["slabs"] = arena.slabs();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+template<typename Hash>
+static void BM_Hash(benchmark::State& state)
+{
+    size_t n = state.range(0);
+    const vector<string>& k = keys(n);
+    Hash h;
+    for (auto _ : state) {
+        size_t sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += h(k[i]);
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+    latency(state, n, [&](size_t i) { benchmark::DoNotOptimize(h(k[i])); });
+}
+
+// ----- Registration -----
+
+typedef void (*BenchFn)(benchmark::State&);
+
+template<typename Table>
+static void registerTable(const string& name, const vector<int64_t>& sizes)
+{
+    const vector<int64_t> loads = { 40, 50, 60, 70, 80, 90 };
+    const struct { const char* op; BenchFn fn; } ops[] = {
+        { "Insert", &BM_Insert<Table> },
+        { "Hit",    &BM_Hit<Table> },
+        { "Miss",   &BM_Miss<Table> },
+        { "Remove", &BM_Remove<Table> },
+    };
+    for (const auto& o : ops)
+        benchmark::RegisterBenchmark((string(o.op) + "/" + name).c_str(), o.fn)
+            ->ArgsProduct({ sizes, loads })
+            ->ArgNames({ "keys", "load" })
+            ->Unit(benchmark::kMillisecond);
+}
+
+int main(int argc, char** argv)
+{
+    int64_t maxKeys = 1000000;
+    // take our own options out before benchmark sees the rest
+    int out = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--max-keys=", 11) == 0)
+            maxKeys = atoll(argv[i] + 11);
+        else if (strncmp(argv[i], "--dict=", 7) == 0)
+            dictFile = argv[i] + 7;
+        else
+            argv[out++] = argv[i];
+    }
+    argc = out;
+
+    vector<int64_t> sizes;
+    for (int64_t n = 1000; n <= maxKeys && n <= 10000000; n *= 10)
+        sizes.push_back(n);
+    if (sizes.empty()) {
+        cerr << "ht-perf: --max-keys must be at least 1000" << endl;
+        return 1;
+    }
+
+    registerTable<LinearTable>("Linear", sizes);
+    registerTable<DoubleTable>("DoubleHash", sizes);
+    registerTable<RobinHoodTable>("RobinHood", sizes);
+    registerTable<IncrementalTable>("Incremental", sizes);
+    registerTable<StdMap>("unordered_map", sizes);
+    benchmark::RegisterBenchmark("InsertBatch/DoubleHash", &BM_InsertBatch<DoubleTable>)
+        ->ArgsProduct({ sizes, { 40, 70 } })->ArgNames({ "keys", "load" })
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+    benchmark::RegisterBenchmark("InsertBatch/Sharded", &BM_InsertBatch<ShardedTable>)
+        ->ArgsProduct({ sizes, { 40, 70 } })->ArgNames({ "keys", "load" })
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+    benchmark::RegisterBenchmark("Build/Heap", &BM_BuildHeap)
+        ->ArgsProduct({ sizes, { 40, 70 } })->ArgNames({ "keys", "load" })
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("Build/Arena", &BM_BuildArena)
+        ->ArgsProduct({ sizes, { 40, 70 } })->ArgNames({ "keys", "load" })
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("Hash/MyStringHash", &BM_Hash<MyStringHash>)
+        ->ArgsProduct({ sizes })->ArgNames({ "keys" });
+    benchmark::RegisterBenchmark("Hash/std::hash", &BM_Hash<std::hash<string> >)
+        ->ArgsProduct({ sizes })->ArgNames({ "keys" });
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
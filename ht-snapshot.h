@@ -0,0 +1,326 @@
+#ifndef HT_SNAPSHOT_H
+#define HT_SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ht.h"
+#include "hash.h"
+
+// ----------------------------- Snapshots -----------------------------------
+//
+// A HashTable with string keys, MyStringHash and trivially copyable values
+// can be written to a flat binary file (native byte order) and mapped back
+// read-only with MappedHashTable. The file has a header, then one slot per
+// bucket, in the same positions as in the table so that every probe
+// sequence carries over, then a pool holding the key bytes:
+//
+//   SnapshotHeader | SnapshotSlot<V>[buckets] | key bytes
+//
+// Mapping the file does no parsing and no allocation, so a process can
+// serve lookups as soon as it starts, and processes mapping the same file
+// share one page-cache copy. The header records the capacity's position in
+// sizes[] and the rValues of the table's hasher (and of its prober's, for
+// DoubleHashProber): the hashes in the file are only good for a hasher with
+// those seeds, which MyStringHash(false) picks at random.
+
+struct SnapshotHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t slotSize;
+    uint32_t valueSize;
+    uint8_t  prober;        // SnapshotProber
+    uint8_t  powerOfTwo;
+    uint16_t reserved;
+    uint64_t capacityIndex;
+    uint64_t buckets;
+    uint64_t count;
+    uint64_t poolSize;
+    uint64_t rValues[5];
+    uint64_t probeRValues[5];
+};
+
+static const char SNAPSHOT_MAGIC[8] = {'H','T','S','N','A','P','\0','\0'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+template <typename V>
+struct SnapshotSlot {
+    enum State : uint32_t { EMPTY, FULL, DELETED };
+    uint64_t hash;          // MyStringHash of the key
+    uint64_t keyOffset;     // into the key pool
+    uint32_t keyLength;
+    uint32_t state;
+    V        value;
+};
+
+// The probers a snapshot can be searched with, and their seeds.
+enum SnapshotProber : uint8_t { SNAPSHOT_LINEAR = 1, SNAPSHOT_ROBIN_HOOD, SNAPSHOT_DOUBLE_HASH };
+
+template <typename K, typename C>
+SnapshotProber snapshotProber(const LinearProber<K, C>&, uint64_t*) { return SNAPSHOT_LINEAR; }
+template <typename K, typename C>
+SnapshotProber snapshotProber(const RobinHoodProber<K, C>&, uint64_t*) { return SNAPSHOT_ROBIN_HOOD; }
+template <typename K, typename C>
+SnapshotProber snapshotProber(const DoubleHashProber<K, MyStringHash, C>& p, uint64_t* seeds)
+{
+    for (int i = 0; i < 5; ++i) seeds[i] = p.h2_.rValues[i];
+    return SNAPSHOT_DOUBLE_HASH;
+}
+
+// Give the prober the seeds stored in a snapshot.
+template <typename P>
+void adoptProberSeeds(P&, const uint64_t*) {}
+template <typename K, typename C>
+void adoptProberSeeds(DoubleHashProber<K, MyStringHash, C>& p, const uint64_t* seeds)
+{
+    for (int i = 0; i < 5; ++i) p.h2_.rValues[i] = seeds[i];
+}
+
+// Write t to fname. Throws std::logic_error during an incremental resize
+// (finishResize() first) and std::runtime_error on I/O failure.
+template <typename K, typename V, typename P, typename E, typename A>
+void saveSnapshot(const HashTable<K, V, P, MyStringHash, E, A>& t, const std::string& fname)
+{
+    static_assert(std::is_trivially_copyable<V>::value,
+                  "snapshot values are stored as raw bytes");
+    static_assert(alignof(SnapshotSlot<V>) <= alignof(SnapshotHeader),
+                  "slots must stay aligned behind the header");
+    typedef SnapshotSlot<V> Slot;
+    if (t.resizing())
+        throw std::logic_error("cannot snapshot a table in the middle of a resize");
+
+    SnapshotHeader hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.slotSize = sizeof(Slot);
+    hdr.valueSize = sizeof(V);
+    hdr.prober = snapshotProber(t.prober(), hdr.probeRValues);
+    hdr.powerOfTwo = P::Capacity::powerOfTwo;
+    hdr.capacityIndex = t.capacityIndex();
+    hdr.buckets = t.capacity();
+    hdr.count = t.size();
+    for (int i = 0; i < 5; ++i) hdr.rValues[i] = t.hasher().rValues[i];
+
+    // zeroed, so padding bytes are written as zeros
+    std::vector<Slot> slots(t.capacity());
+    std::memset(static_cast<void*>(slots.data()), 0, slots.size() * sizeof(Slot));
+    std::string pool;
+    for (size_t i = 0; i < slots.size(); ++i) {
+        auto p = t.bucket(i);
+        if (!p) continue;
+        const K& key = p->item.first;
+        Slot& s = slots[i];
+        s.state = p->deleted ? Slot::DELETED : Slot::FULL;
+        s.hash = t.hasher()(key);
+        s.keyOffset = pool.size();
+        s.keyLength = static_cast<uint32_t>(key.size());
+        std::memcpy(static_cast<void*>(&s.value), &p->item.second, sizeof(V));
+        pool.append(key.data(), key.size());
+    }
+    hdr.poolSize = pool.size();
+
+    std::ofstream out(fname, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    out.write(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(Slot));
+    out.write(pool.data(), pool.size());
+    if (out.fail())
+        throw std::runtime_error("unable to write snapshot");
+}
+
+// -------------------------- MappedHashTable --------------------------------
+//
+// Read-only lookups in a snapshot mapped with mmap. ProberType must probe
+// as the saved table's did: the same kind of prober over the same
+// capacity policy (its key type does not matter). Lookups take any string
+// as a std::string_view and never allocate; they keep no state, so any
+// number of threads may look up at once.
+//
+// Mapping checks the header and then every slot, once: its state must be
+// one of Slot's and its key must lie inside the pool, so no lookup can read
+// past the mapping however the file was damaged.
+
+template <typename V, typename ProberType = DoubleHashProber<std::string, MyStringHash> >
+class MappedHashTable {
+    static_assert(std::is_trivially_copyable<V>::value,
+                  "snapshot values are stored as raw bytes");
+public:
+    using ValueType = V;
+    typedef SnapshotSlot<V> Slot;
+
+    // Map fname and take the hasher (and prober) seeds it was saved with.
+    // Throws std::invalid_argument if the file cannot be mapped or is not a
+    // snapshot that ProberType and V can read.
+    explicit MappedHashTable(const std::string& fname)
+    {
+        mapFile(fname);
+        for (int i = 0; i < 5; ++i) hash_.rValues[i] = hdr_->rValues[i];
+        adoptProberSeeds(prober_, hdr_->probeRValues);
+    }
+
+    // Also check that the snapshot was saved with these seeds, e.g. those
+    // of the tables or rolling hashes the lookups will be combined with.
+    MappedHashTable(const std::string& fname, const MyStringHash& hash,
+                    const ProberType& prober = ProberType())
+      : hash_(hash), prober_(prober)
+    {
+        mapFile(fname);
+        uint64_t seeds[5] = {0, 0, 0, 0, 0};
+        snapshotProber(prober_, seeds);
+        bool match = true;
+        for (int i = 0; i < 5; ++i)
+            match = match && hdr_->rValues[i] == hash_.rValues[i]
+                          && hdr_->probeRValues[i] == seeds[i];
+        if (!match) {
+            unmap();
+            throw std::invalid_argument("snapshot hash seeds do not match");
+        }
+    }
+
+    MappedHashTable(const MappedHashTable&) = delete;
+    MappedHashTable& operator=(const MappedHashTable&) = delete;
+    MappedHashTable(MappedHashTable&& other)
+      : hash_(other.hash_), prober_(other.prober_)
+    {
+        swap(other);
+    }
+    MappedHashTable& operator=(MappedHashTable&& other) {
+        swap(other);
+        return *this;
+    }
+    ~MappedHashTable() { unmap(); }
+
+    void swap(MappedHashTable& other) {
+        std::swap(hash_, other.hash_);
+        std::swap(prober_, other.prober_);
+        std::swap(map_, other.map_);
+        std::swap(len_, other.len_);
+        std::swap(hdr_, other.hdr_);
+        std::swap(slots_, other.slots_);
+        std::swap(pool_, other.pool_);
+    }
+
+    size_t size() const { return hdr_->count; }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return hdr_->buckets; }
+    const MyStringHash& hasher() const { return hash_; }
+
+    const ValueType* find(std::string_view key) const {
+        return findByHash(hash_(key), key);
+    }
+    // find() for a key whose hash is already known: h must equal
+    // hasher()(key)
+    const ValueType* findByHash(HASH_INDEX_T h, std::string_view key) const {
+        HASH_INDEX_T m = hdr_->buckets;
+        ProberType prober = prober_;
+        startProbe(prober, Capacity::home(h, m), m, probeKeyHash(prober, key), key);
+        for (size_t i = 0; i < m; ++i) {
+            HASH_INDEX_T loc = prober.next();
+            if (loc == ProberType::npos) return nullptr;
+            const Slot& s = slots_[loc];
+            if (s.state == Slot::EMPTY) return nullptr;
+            if (s.state == Slot::FULL && s.hash == h && s.keyLength == key.size() &&
+                std::memcmp(pool_ + s.keyOffset, key.data(), key.size()) == 0)
+                return &s.value;
+            // Robin Hood order: key would have been placed before s
+            if (ProberType::robinHood &&
+                Capacity::wrap(loc + m - Capacity::home(s.hash, m), m) < i)
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+    bool contains(std::string_view key) const { return find(key) != nullptr; }
+
+    const ValueType& at(std::string_view key) const {
+        const ValueType* v = find(key);
+        if (!v) throw std::out_of_range("Bad key");
+        return *v;
+    }
+    const ValueType& operator[](std::string_view key) const { return at(key); }
+
+private:
+    typedef typename ProberType::Capacity Capacity;
+
+    void mapFile(const std::string& fname) {
+        int fd = ::open(fname.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::invalid_argument("unable to open snapshot file");
+        struct stat st;
+        if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+            close(fd);
+            throw std::invalid_argument("not a hash table snapshot");
+        }
+        len_ = st.st_size;
+        map_ = mmap(nullptr, len_, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map_ == MAP_FAILED) {
+            map_ = nullptr;
+            throw std::invalid_argument("unable to map snapshot file");
+        }
+
+        hdr_ = static_cast<const SnapshotHeader*>(map_);
+        uint64_t seeds[5];
+        // buckets is one of sizes[] (below 2^32) before it is multiplied,
+        // and the pool size is compared with what is left, so nothing here
+        // can overflow
+        if (std::memcmp(hdr_->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+            hdr_->version != SNAPSHOT_VERSION ||
+            hdr_->capacityIndex >= Capacity::count ||
+            hdr_->buckets != Capacity::sizes[hdr_->capacityIndex] ||
+            len_ - sizeof(SnapshotHeader) < hdr_->buckets * sizeof(Slot) ||
+            hdr_->poolSize != len_ - sizeof(SnapshotHeader) - hdr_->buckets * sizeof(Slot)) {
+            unmap();
+            throw std::invalid_argument("not a hash table snapshot");
+        }
+        if (hdr_->slotSize != sizeof(Slot) || hdr_->valueSize != sizeof(V) ||
+            hdr_->powerOfTwo != Capacity::powerOfTwo ||
+            hdr_->prober != snapshotProber(prober_, seeds)) {
+            unmap();
+            throw std::invalid_argument("snapshot was saved from another kind of table");
+        }
+        slots_ = reinterpret_cast<const Slot*>(hdr_ + 1);
+        pool_ = reinterpret_cast<const char*>(slots_ + hdr_->buckets);
+
+        uint64_t full = 0;
+        for (uint64_t i = 0; i < hdr_->buckets; ++i) {
+            const Slot& s = slots_[i];
+            if ((s.state != Slot::EMPTY && s.state != Slot::FULL && s.state != Slot::DELETED) ||
+                s.keyOffset > hdr_->poolSize ||
+                s.keyLength > hdr_->poolSize - s.keyOffset) {
+                unmap();
+                throw std::invalid_argument("not a hash table snapshot");
+            }
+            full += s.state == Slot::FULL;
+        }
+        if (full != hdr_->count) {
+            unmap();
+            throw std::invalid_argument("not a hash table snapshot");
+        }
+    }
+
+    void unmap() {
+        if (map_) munmap(map_, len_);
+        map_ = nullptr;
+    }
+
+    MyStringHash          hash_;
+    ProberType            prober_;
+    void*                 map_ = nullptr;
+    size_t                len_ = 0;
+    const SnapshotHeader* hdr_ = nullptr;
+    const Slot*           slots_ = nullptr;
+    const char*           pool_ = nullptr;
+};
+
+#endif // HT_SNAPSHOT_H
@@ -6,14 +6,228 @@
 #include <stdexcept>
 #include <utility>
 #include <functional>
+#include <iterator>
+#include <type_traits>
+#include <memory>
+#include <tuple>
+#ifdef HT_STATS
+#include <chrono>
+#endif
 
 typedef std::size_t HASH_INDEX_T;
 
+#if defined(__GNUC__)
+#define HT_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define HT_PREFETCH(addr) ((void)0)
+#endif
+
+// --------------------------- Statistics ------------------------------------
+//
+// Compile with -DHT_STATS to have the tables keep probe-length histograms
+// and resize timings. Without it none of this exists and the tables carry
+// no extra state or work.
+
+#ifdef HT_STATS
+#define HT_STATS_ONLY(x) x
+
+struct HashTableStats {
+    enum Op { HIT, MISS, INSERT, NUM_OPS };
+    // probe lengths >= HIST_SIZE-1 share the last bucket
+    static const size_t HIST_SIZE = 32;
+
+    size_t histogram[NUM_OPS][HIST_SIZE];
+    size_t maxProbe[NUM_OPS];
+    size_t resizes;
+    double resizeSeconds;
+
+    HashTableStats() { clear(); }
+
+    void clear() {
+        for (int op = 0; op < NUM_OPS; ++op) {
+            for (size_t i = 0; i < HIST_SIZE; ++i) histogram[op][i] = 0;
+            maxProbe[op] = 0;
+        }
+        resizes = 0;
+        resizeSeconds = 0;
+    }
+
+    void record(Op op, size_t probes) {
+        ++histogram[op][probes < HIST_SIZE ? probes : HIST_SIZE - 1];
+        if (probes > maxProbe[op]) maxProbe[op] = probes;
+    }
+
+    size_t count(Op op) const {
+        size_t n = 0;
+        for (size_t i = 0; i < HIST_SIZE; ++i) n += histogram[op][i];
+        return n;
+    }
+
+    double meanProbe(Op op) const {
+        size_t n = 0, total = 0;
+        for (size_t i = 0; i < HIST_SIZE; ++i) {
+            n += histogram[op][i];
+            total += i * histogram[op][i];
+        }
+        return n ? double(total) / n : 0.0;
+    }
+
+    void report(std::ostream& out) const {
+        static const char* names[NUM_OPS] = { "hit", "miss", "insert" };
+        for (int op = 0; op < NUM_OPS; ++op) {
+            Op o = static_cast<Op>(op);
+            out << names[op] << ": " << count(o) << " ops, mean probe "
+                << meanProbe(o) << ", max probe " << maxProbe[op] << "\n  ";
+            for (size_t i = 1; i < HIST_SIZE; ++i)
+                if (histogram[op][i])
+                    out << i << (i == HIST_SIZE - 1 ? "+" : "") << ":" << histogram[op][i] << " ";
+            out << "\n";
+        }
+        out << "resizes: " << resizes << " (" << resizeSeconds * 1000 << " ms)\n";
+    }
+};
+
+// Longest run of consecutive non-empty slots, wrapping around the end.
+// This is the primary clustering LinearProber suffers from.
+template <typename IsUsed>
+size_t longestCluster(size_t m, IsUsed used)
+{
+    size_t best = 0, run = 0, lead = 0;
+    bool leading = true;
+    for (size_t i = 0; i < m; ++i) {
+        if (used(i)) {
+            ++run;
+        } else {
+            if (leading) { lead = run; leading = false; }
+            if (run > best) best = run;
+            run = 0;
+        }
+    }
+    if (leading) return m;
+    // the trailing run continues into the leading one
+    return run + lead > best ? run + lead : best;
+}
+
+class ResizeTimer {
+public:
+    explicit ResizeTimer(HashTableStats& stats)
+      : stats_(stats), start_(std::chrono::steady_clock::now()) {}
+    ~ResizeTimer() {
+        ++stats_.resizes;
+        stats_.resizeSeconds += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start_).count();
+    }
+private:
+    HashTableStats& stats_;
+    std::chrono::steady_clock::time_point start_;
+};
+#else
+#define HT_STATS_ONLY(x)
+#endif
+
+// Hash n keys into out[], through Hash::hashBatch when the hasher has one.
+template <typename Hash, typename Key>
+auto hashKeys(const Hash& hash, const Key* keys, size_t n, HASH_INDEX_T* out, int)
+    -> decltype(hash.hashBatch(keys, n, out), void())
+{
+    hash.hashBatch(keys, n, out);
+}
+
+template <typename Hash, typename Key>
+void hashKeys(const Hash& hash, const Key* keys, size_t n, HASH_INDEX_T* out, long)
+{
+    for (size_t i = 0; i < n; ++i) out[i] = hash(keys[i]);
+}
+
+template <typename Hash, typename Key>
+void hashKeys(const Hash& hash, const Key* keys, size_t n, HASH_INDEX_T* out)
+{
+    hashKeys(hash, keys, n, out, 0);
+}
+
+// ----------------------------- Capacities ----------------------------------
+//
+// A capacity policy lists the table sizes a table steps through and how a
+// hash or probe offset is reduced to a slot index. It is chosen through the
+// prober's Capacity parameter so the prober and the table always agree.
+
+// Prime table sizes; reduction is a plain modulo. Declared as a template so
+// the static array can live in the header.
+template <typename Dummy = void>
+struct PrimeCapacityT {
+    static const bool powerOfTwo = false;
+    static const HASH_INDEX_T sizes[];
+    static const size_t count;
+
+    static HASH_INDEX_T home(HASH_INDEX_T h, HASH_INDEX_T m) { return h % m; }
+    static HASH_INDEX_T wrap(HASH_INDEX_T loc, HASH_INDEX_T m) { return loc % m; }
+};
+
+template<typename D>
+const HASH_INDEX_T PrimeCapacityT<D>::sizes[] = {
+    11,23,47,97,197,397,797,1597,
+    3203,6421,12853,25717,51437,102877,
+    205759,411527,823117,1646237,3292489,
+    6584983,13169977,26339969,52679969,
+    105359969,210719881,421439783,
+    842879579,1685759167
+};
+
+template<typename D>
+const size_t PrimeCapacityT<D>::count = sizeof(PrimeCapacityT<D>::sizes)/sizeof(HASH_INDEX_T);
+
+typedef PrimeCapacityT<> PrimeCapacity;
+
+// Power-of-two table sizes: every reduction is a mask. The hash goes
+// through a 64-bit finalizer first so that its low bits, which are all a
+// mask keeps, depend on every input bit.
+template <typename Dummy = void>
+struct PowerOfTwoCapacityT {
+    static const bool powerOfTwo = true;
+    static const HASH_INDEX_T sizes[];
+    static const size_t count;
+
+    static HASH_INDEX_T mix(HASH_INDEX_T h) {
+        unsigned long long x = h;
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ULL;
+        x ^= x >> 33;
+        return static_cast<HASH_INDEX_T>(x);
+    }
+    static HASH_INDEX_T home(HASH_INDEX_T h, HASH_INDEX_T m) { return mix(h) & (m - 1); }
+    static HASH_INDEX_T wrap(HASH_INDEX_T loc, HASH_INDEX_T m) { return loc & (m - 1); }
+};
+
+template<typename D>
+const HASH_INDEX_T PowerOfTwoCapacityT<D>::sizes[] = {
+    16,32,64,128,256,512,1024,2048,
+    4096,8192,16384,32768,65536,131072,
+    262144,524288,1048576,2097152,4194304,
+    8388608,16777216,33554432,67108864,
+    134217728,268435456,536870912,
+    1073741824,2147483648u
+};
+
+template<typename D>
+const size_t PowerOfTwoCapacityT<D>::count = sizeof(PowerOfTwoCapacityT<D>::sizes)/sizeof(HASH_INDEX_T);
+
+typedef PowerOfTwoCapacityT<> PowerOfTwoCapacity;
+
 // ------------------------------ Probers ------------------------------------
 
-template <typename KeyType>
+template <typename KeyType, typename CapacityType = PrimeCapacity>
 struct Prober {
+    typedef CapacityType Capacity;
     static const HASH_INDEX_T npos = static_cast<HASH_INDEX_T>(-1);
+    // number of consecutive slots each next() covers (see GroupProber)
+    static const HASH_INDEX_T groupWidth = 1;
+    // whether the table keeps Robin Hood order (see RobinHoodProber)
+    static const bool robinHood = false;
+    // whether keyHash() and initHashed() stand in for init() (see below)
+    static const bool hashedInit = false;
+    typedef KeyType ProbeKey;
     HASH_INDEX_T start_, m_;
     size_t      numProbes_;
 
@@ -23,120 +237,413 @@ struct Prober {
         numProbes_ = 0;
     }
 
+    // init() split in two: keyHash() is everything init() needs from the
+    // key, initHashed() the rest. A table that caches keyHash() can restart
+    // a probe sequence without touching the key. Tables only use them for
+    // probers that set hashedInit, which promises that the two together do
+    // what init() does; any other prober is always started with init(), so
+    // one that overrides just init() and next() keeps working. keyHash()
+    // takes any type the table can look up by (see TransparentKey), not
+    // just KeyType.
+    template <typename Q>
+    HASH_INDEX_T keyHash(const Q&) const { return 0; }
+    void initHashed(HASH_INDEX_T start, HASH_INDEX_T m, HASH_INDEX_T) {
+        start_ = start;
+        m_ = m;
+        numProbes_ = 0;
+    }
+
     HASH_INDEX_T next() {
         throw std::logic_error("Prober::next must be overridden");
     }
 };
 
-template <typename KeyType>
-struct LinearProber : public Prober<KeyType> {
+template <typename KeyType, typename Capacity = PrimeCapacity>
+struct LinearProber : public Prober<KeyType, Capacity> {
+    static const bool hashedInit = true;
+
     HASH_INDEX_T next() {
         if (this->numProbes_ >= this->m_) return this->npos;
-        HASH_INDEX_T loc = (this->start_ + this->numProbes_) % this->m_;
+        HASH_INDEX_T loc = Capacity::wrap(this->start_ + this->numProbes_, this->m_);
         ++this->numProbes_;
         return loc;
     }
 };
 
-template <typename KeyType, typename Hash2>
-struct DoubleHashProber : public Prober<KeyType> {
+// Linear probing with Robin Hood insertion, which HashTable carries out: an
+// item being placed takes the slot of any item nearer its own home slot and
+// that item moves on, so every run stays ordered by home slot. A lookup can
+// then stop at the first item nearer its home than the key would be, and
+// remove() shifts the rest of the run back one slot instead of leaving a
+// tombstone. Probe lengths vary much less than with LinearProber, so the
+// table can run at an alpha of 0.85-0.9.
+template <typename KeyType, typename Capacity = PrimeCapacity>
+struct RobinHoodProber : public LinearProber<KeyType, Capacity> {
+    static const bool robinHood = true;
+};
+
+template <typename KeyType, typename Hash2, typename Capacity = PrimeCapacity>
+struct DoubleHashProber : public Prober<KeyType, Capacity> {
     Hash2        h2_;
     HASH_INDEX_T step_;
     static const HASH_INDEX_T modVals[];
     static const int modCount;
+    static const bool hashedInit = true;
 
     DoubleHashProber(const Hash2& h2 = Hash2()) : h2_(h2) {}
 
     void init(HASH_INDEX_T start, HASH_INDEX_T m, const KeyType& key) {
-        Prober<KeyType>::init(start, m, key);
+        initHashed(start, m, h2_(key));
+    }
+
+    template <typename Q>
+    HASH_INDEX_T keyHash(const Q& key) const { return h2_(key); }
+
+    void initHashed(HASH_INDEX_T start, HASH_INDEX_T m, HASH_INDEX_T h2) {
+        Prober<KeyType, Capacity>::initHashed(start, m, h2);
+        if (Capacity::powerOfTwo) {
+            // any odd step is coprime with 2^k, so the sequence is full-period
+            step_ = (h2 | 1) & (m - 1);
+            return;
+        }
         HASH_INDEX_T mod = modVals[0];
         for (int i = 0; i < modCount && modVals[i] < m; ++i)
             mod = modVals[i];
-        step_ = mod - (h2_(key) % mod);
+        step_ = mod - (h2 % mod);
     }
 
     HASH_INDEX_T next() {
         if (this->numProbes_ >= this->m_) return this->npos;
-        HASH_INDEX_T loc = (this->start_ + this->numProbes_ * step_) % this->m_;
+        HASH_INDEX_T loc = Capacity::wrap(this->start_ + this->numProbes_ * step_, this->m_);
         ++this->numProbes_;
         return loc;
     }
 };
 
-template<typename K, typename H2>
-const HASH_INDEX_T DoubleHashProber<K,H2>::modVals[] = {
+template<typename K, typename H2, typename C>
+const HASH_INDEX_T DoubleHashProber<K,H2,C>::modVals[] = {
     7,19,43,89,193,389,787,1583,3191,6397,12841,25703,
     51431,102871,205721,411503,823051,1646221,3292463,6584957,
     13169963,26339921,52679927,105359939,210719881,421439783,
     842879563,1685759113
 };
 
-template<typename K, typename H2>
-const int DoubleHashProber<K,H2>::modCount = sizeof(DoubleHashProber<K,H2>::modVals)/sizeof(HASH_INDEX_T);
+template<typename K, typename H2, typename C>
+const int DoubleHashProber<K,H2,C>::modCount = sizeof(DoubleHashProber<K,H2,C>::modVals)/sizeof(HASH_INDEX_T);
+
+// Visits the table one 16-slot group at a time: next() returns the first
+// slot of each group, and the table is expected to compare all the slots of
+// the group at once against per-slot control bytes. Only FlatHashTable keeps
+// control bytes, so this prober cannot be used with HashTable.
+template <typename KeyType, typename Capacity = PrimeCapacity>
+struct GroupProber : public Prober<KeyType, Capacity> {
+    static const HASH_INDEX_T groupWidth = 16;
+    static const bool hashedInit = true;
+
+    HASH_INDEX_T next() {
+        // ceil(m / groupWidth) consecutive groups cover every slot once
+        if (this->numProbes_ * groupWidth >= this->m_) return this->npos;
+        HASH_INDEX_T loc = Capacity::wrap(this->start_ + this->numProbes_ * groupWidth, this->m_);
+        ++this->numProbes_;
+        return loc;
+    }
+};
+
+// Start prober on the sequence for key from bucket start of m: through
+// initHashed() with the key's cached keyHash() ph when the prober allows
+// it, otherwise through init(), converting a lookup key of another type to
+// the prober's key type.
+template <typename P, typename Q>
+void startProbe(P& prober, HASH_INDEX_T start, HASH_INDEX_T m, HASH_INDEX_T ph, const Q& key)
+{
+    if constexpr (P::hashedInit)
+        prober.initHashed(start, m, ph);
+    else if constexpr (std::is_same<Q, typename P::ProbeKey>::value)
+        prober.init(start, m, key);
+    else
+        prober.init(start, m, typename P::ProbeKey(key));
+}
+
+// The keyHash() of key for startProbe(), or 0 if the prober does not use it
+template <typename P, typename Q>
+HASH_INDEX_T probeKeyHash(const P& prober, const Q& key)
+{
+    if constexpr (P::hashedInit)
+        return prober.keyHash(key);
+    else
+        return 0;
+}
 
 // ---------------------------- HashTable ------------------------------------
 
+// Whether HashTable stores each item's full hash (and its prober's
+// keyHash()) next to the item. The cached hash rejects almost every
+// non-matching item before KeyEqual runs, and lets resize() place items
+// without hashing any key. On by default for all but arithmetic and
+// pointer keys, whose comparisons are as cheap as the hash check;
+// specialize to override.
+template <typename K>
+struct CacheHash
+    : std::integral_constant<bool, !std::is_arithmetic<K>::value && !std::is_pointer<K>::value> {};
+
+template <bool Enabled>
+struct HashCache {
+    void setHash(HASH_INDEX_T, HASH_INDEX_T) {}
+    bool hashMayMatch(HASH_INDEX_T) const { return true; }
+};
+
+template <>
+struct HashCache<true> {
+    HASH_INDEX_T hash, probeHash;
+    void setHash(HASH_INDEX_T h, HASH_INDEX_T ph) { hash = h; probeHash = ph; }
+    bool hashMayMatch(HASH_INDEX_T h) const { return hash == h; }
+};
+
+// Heterogeneous lookup, as in C++20's unordered containers: when both the
+// hash and the key equality declare is_transparent, find(), at(), remove()
+// and the rest also accept any other type Q they take (std::string_view for
+// string keys, with MyStringHash and std::equal_to<>), and nothing of type
+// KeyType is built for the lookup.
+template <typename T, typename = void>
+struct IsTransparent : std::false_type {};
+template <typename T>
+struct IsTransparent<T, std::void_t<typename T::is_transparent> > : std::true_type {};
+
+template <typename Hash, typename KeyEqual, typename Q>
+using TransparentKey = typename std::enable_if<
+    IsTransparent<Hash>::value && IsTransparent<KeyEqual>::value, Q>::type;
+
+// Whether a table may skip destroying its items because the allocator
+// releases all of their memory at once and the items own nothing else. The
+// table then frees only its bucket array. False for every allocator but
+// those that say otherwise (see ArenaAllocator in arena.h).
+template <typename Alloc, typename Item>
+struct SkipItemDestroy : std::false_type {};
+
 template<
     typename K,
     typename V,
     typename ProberType = LinearProber<K>,
     typename Hash       = std::hash<K>,
-    typename KeyEqual   = std::equal_to<K>
+    typename KeyEqual   = std::equal_to<K>,
+    typename Allocator  = std::allocator<std::pair<K,V> >
 >
 class HashTable {
+    static_assert(ProberType::groupWidth == 1,
+                  "group probing needs the control bytes of FlatHashTable");
 public:
     using KeyType   = K;
     using ValueType = V;
     using ItemType  = std::pair<KeyType,ValueType>;
     using Hasher    = Hash;
+    using AllocatorType = Allocator;
 
-    struct HashItem {
+    struct HashItem : public HashCache<CacheHash<K>::value> {
         ItemType item;
         bool     deleted;
-        HashItem(const ItemType& p) : item(p), deleted(false) {}
+        template <typename... Args>
+        explicit HashItem(std::in_place_t, Args&&... args)
+          : item(std::forward<Args>(args)...), deleted(false) {}
     };
 
     HashTable(double alpha = 0.4,
               const ProberType& prober = ProberType(),
               const Hasher& hash     = Hasher(),
-              const KeyEqual& eq     = KeyEqual())
+              const KeyEqual& eq     = KeyEqual(),
+              const Allocator& alloc = Allocator())
       : prober_(prober)
       , hash_(hash)
       , eq_(eq)
+      , alloc_(alloc)
       , alpha_(alpha)
       , totalProbes_(0)
       , index_(0)
       , count_(0)
       , used_(0)
+      , migrated_(0)
+      , oldCount_(0)
+      , migrateStep_(0)
+    {
+        table_.assign(Capacity::sizes[index_], nullptr);
+    }
+
+    // Build from a range of ItemType. For forward iterators the table is
+    // sized once up front so no resize happens while loading.
+    template<typename InputIt,
+             typename = typename std::iterator_traits<InputIt>::iterator_category>
+    HashTable(InputIt first, InputIt last,
+              double alpha = 0.4,
+              const ProberType& prober = ProberType(),
+              const Hasher& hash     = Hasher(),
+              const KeyEqual& eq     = KeyEqual(),
+              const Allocator& alloc = Allocator())
+      : HashTable(alpha, prober, hash, eq, alloc)
+    {
+        reserveFor(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    // Copies get their own items (tombstones included, so every probe
+    // sequence is unchanged, and a resize in progress stays in progress);
+    // moves take the buckets and leave other empty.
+    HashTable(const HashTable& other)
+      : prober_(other.prober_)
+      , hash_(other.hash_)
+      , eq_(other.eq_)
+      , alloc_(NodeTraits::select_on_container_copy_construction(other.alloc_))
+      , alpha_(other.alpha_)
+      , totalProbes_(0)
+      , index_(other.index_)
+      , count_(other.count_)
+      , used_(other.used_)
+      , table_(other.table_.size(), nullptr)
+      , old_(other.old_.size(), nullptr)
+      , migrated_(other.migrated_)
+      , oldCount_(other.oldCount_)
+      , migrateStep_(other.migrateStep_)
+    {
+        for (size_t i = 0; i < table_.size(); ++i)
+            if (other.table_[i]) table_[i] = newItem(*other.table_[i]);
+        for (size_t i = 0; i < old_.size(); ++i) {
+            HashItem* p = other.old_[i];
+            old_[i] = p && p != moved() ? newItem(*p) : p;
+        }
+    }
+
+    HashTable(HashTable&& other)
+      : HashTable(other.alpha_, other.prober_, other.hash_, other.eq_, Allocator(other.alloc_))
     {
-        table_.assign(sizes[index_], nullptr);
+        swap(other);
+    }
+
+    HashTable& operator=(HashTable other) {
+        swap(other);
+        return *this;
     }
 
     ~HashTable() {
-        for (auto p : table_) delete p;
+        if (SkipItemDestroy<Allocator, ItemType>::value) return;
+        for (auto p : table_) if (p) deleteItem(p);
+        for (auto p : old_) if (p && p != moved()) deleteItem(p);
+    }
+
+    void swap(HashTable& other) {
+        std::swap(prober_, other.prober_);
+        std::swap(hash_, other.hash_);
+        std::swap(eq_, other.eq_);
+        std::swap(alloc_, other.alloc_);
+        std::swap(alpha_, other.alpha_);
+        std::swap(totalProbes_, other.totalProbes_);
+        std::swap(index_, other.index_);
+        std::swap(count_, other.count_);
+        std::swap(used_, other.used_);
+        table_.swap(other.table_);
+        old_.swap(other.old_);
+        std::swap(migrated_, other.migrated_);
+        std::swap(oldCount_, other.oldCount_);
+        std::swap(migrateStep_, other.migrateStep_);
+#ifdef HT_STATS
+        std::swap(stats_, other.stats_);
+#endif
     }
 
     bool empty() const { return count_ == 0; }
     size_t size()  const { return count_; }
+    size_t capacity() const { return table_.size(); }
 
+    // Insert p, or replace the value of an existing key.
     void insert(const ItemType& p) {
-        // Resize if loading factor >= alpha
-        if (double(used_) / table_.size() >= alpha_)
-            resize();
-        HASH_INDEX_T loc = probe(p.first);
-        if (loc == npos)
-            throw std::logic_error("HashTable full");
-        if (!table_[loc]) {
-            table_[loc] = new HashItem(p);
-            ++count_; ++used_;
-        } else {
-            table_[loc]->item.second = p.second;
+        insert(p, hash_(p.first));
+    }
+    void insert(ItemType&& p) {
+        HASH_INDEX_T h = hash_(p.first);
+        insert(std::move(p), h);
+    }
+
+    // The std::unordered_map forms, returning the item and whether it is
+    // new. emplace() builds the item from args before looking its key up
+    // and drops it if the key is already there; try_emplace() looks key up
+    // first and only then builds the value from args. Neither touches an
+    // existing item. insert_or_assign() is insert() for a key and value
+    // given apart.
+    template <typename... Args>
+    std::pair<ItemType*, bool> emplace(Args&&... args) {
+        HashItem* p = newItem(std::in_place, std::forward<Args>(args)...);
+        HASH_INDEX_T h = hash_(p->item.first), ph, loc;
+        bool found;
+        try {
+            loc = insertSlot(p->item.first, h, ph, found);
+        } catch (...) {
+            deleteItem(p);
+            throw;
+        }
+        if (found) {
+            deleteItem(p);
+            return std::make_pair(&table_[loc]->item, false);
+        }
+        return std::make_pair(&fill(loc, p, h, ph)->item, true);
+    }
+
+    template <typename... Args>
+    std::pair<ItemType*, bool> try_emplace(const KeyType& key, Args&&... args) {
+        return tryEmplace(key, std::forward<Args>(args)...);
+    }
+    template <typename... Args>
+    std::pair<ItemType*, bool> try_emplace(KeyType&& key, Args&&... args) {
+        return tryEmplace(std::move(key), std::forward<Args>(args)...);
+    }
+
+    template <typename M>
+    std::pair<ItemType*, bool> insert_or_assign(const KeyType& key, M&& value) {
+        return insertOrAssign(key, std::forward<M>(value));
+    }
+    template <typename M>
+    std::pair<ItemType*, bool> insert_or_assign(KeyType&& key, M&& value) {
+        return insertOrAssign(std::move(key), std::forward<M>(value));
+    }
+
+    // Grow (never shrink) straight to the smallest capacity in sizes[] that
+    // takes n items without another resize.
+    void reserve(size_t n) {
+        size_t i = index_;
+        while (n > 0 && double(n - 1) / Capacity::sizes[i] >= alpha_) {
+            if (++i >= Capacity::count)
+                throw std::logic_error("No more capacities");
         }
+        if (i != index_) rebuild(i);
+    }
+
+    // Drop every tombstone, keeping the current capacity.
+    void rehash() { rebuild(index_); }
+
+    // Incremental resizing. With a step of n > 0, a resize only allocates
+    // the new bucket array: each later insert or remove then moves the
+    // items of the next n old buckets across, and lookups also search the
+    // old buckets until they are empty. No insert relinks more than about n
+    // items, instead of every item at once. A step of at least 1/alpha
+    // finishes each move before the next resize is due; otherwise that
+    // resize finishes it first. 0, the default, resizes all at once, as do
+    // reserve(), rehash() and shrink_to_fit(), which finish a resize in
+    // progress.
+    void setIncrementalResize(size_t step) { migrateStep_ = step; }
+    bool resizing() const { return !old_.empty(); }
+    // Move every item still in the old buckets now.
+    void finishResize() { if (resizing()) migrate(old_.size()); }
+
+    // Rebuild at the smallest capacity in sizes[] (possibly the current
+    // one) that holds the current items below alpha.
+    void shrink_to_fit() {
+        size_t i = 0;
+        while (i < index_ && double(count_) / Capacity::sizes[i] >= alpha_) ++i;
+        rebuild(i);
     }
 
     void remove(const KeyType& key) {
-        auto p = internalFind(key);
-        if (p && !p->deleted) { p->deleted = true; --count_; }
+        HASH_INDEX_T h = hash_(key);
+        if (resizing()) migrateFor(key, h);
+        auto p = internalFind(key, h);
+        if (p) erase(p);
     }
 
     const ValueType& at(const KeyType& key) const {
@@ -163,6 +670,86 @@ public:
         return p ? &p->item : nullptr;
     }
 
+    // find() for a key whose hash is already known (say, from a rolling
+    // hash): h must equal hasher()(key). The second form also takes the
+    // prober's keyHash(key), e.g. the step hash of DoubleHashProber, so the
+    // lookup hashes nothing at all.
+    ItemType* findByHash(HASH_INDEX_T h, const KeyType& key) {
+        return findByHash(h, probeKeyHash(prober_, key), key);
+    }
+    const ItemType* findByHash(HASH_INDEX_T h, const KeyType& key) const {
+        return findByHash(h, probeKeyHash(prober_, key), key);
+    }
+    ItemType* findByHash(HASH_INDEX_T h, HASH_INDEX_T probeHash, const KeyType& key) {
+        auto p = internalFindHashed(key, h, probeHash);
+        return p ? &p->item : nullptr;
+    }
+    const ItemType* findByHash(HASH_INDEX_T h, HASH_INDEX_T probeHash, const KeyType& key) const {
+        auto p = internalFindHashed(key, h, probeHash);
+        return p ? &p->item : nullptr;
+    }
+
+    // Heterogeneous forms of the above (see TransparentKey)
+    template <typename Q, typename = TransparentKey<Hash, KeyEqual, Q> >
+    ItemType* find(const Q& key) {
+        auto p = internalFindHashed(key, hash_(key), probeKeyHash(prober_, key));
+        return p ? &p->item : nullptr;
+    }
+    template <typename Q, typename = TransparentKey<Hash, KeyEqual, Q> >
+    const ItemType* find(const Q& key) const {
+        auto p = internalFindHashed(key, hash_(key), probeKeyHash(prober_, key));
+        return p ? &p->item : nullptr;
+    }
+    template <typename Q, typename = TransparentKey<Hash, KeyEqual, Q> >
+    ValueType& at(const Q& key) {
+        auto p = find(key);
+        if (!p) throw std::out_of_range("Bad key");
+        return p->second;
+    }
+    template <typename Q, typename = TransparentKey<Hash, KeyEqual, Q> >
+    const ValueType& at(const Q& key) const {
+        auto p = find(key);
+        if (!p) throw std::out_of_range("Bad key");
+        return p->second;
+    }
+    template <typename Q, typename = TransparentKey<Hash, KeyEqual, Q> >
+    ValueType& operator[](const Q& key) { return at(key); }
+    template <typename Q, typename = TransparentKey<Hash, KeyEqual, Q> >
+    const ValueType& operator[](const Q& key) const { return at(key); }
+    template <typename Q, typename = TransparentKey<Hash, KeyEqual, Q> >
+    void remove(const Q& key) {
+        HASH_INDEX_T h = hash_(key);
+        if (resizing()) migrateFor(key, h);
+        auto p = internalFindHashed(key, h, probeKeyHash(prober_, key));
+        if (p) erase(p);
+    }
+    template <typename Q, typename = TransparentKey<Hash, KeyEqual, Q> >
+    ItemType* findByHash(HASH_INDEX_T h, HASH_INDEX_T probeHash, const Q& key) {
+        auto p = internalFindHashed(key, h, probeHash);
+        return p ? &p->item : nullptr;
+    }
+    template <typename Q, typename = TransparentKey<Hash, KeyEqual, Q> >
+    const ItemType* findByHash(HASH_INDEX_T h, HASH_INDEX_T probeHash, const Q& key) const {
+        auto p = internalFindHashed(key, h, probeHash);
+        return p ? &p->item : nullptr;
+    }
+
+    // insert() for an item whose hash is already known: h must equal
+    // hasher()(p.first)
+    void insertByHash(HASH_INDEX_T h, const ItemType& p) {
+        insert(p, h);
+    }
+
+    const Hasher& hasher() const { return hash_; }
+    const ProberType& prober() const { return prober_; }
+    // The bucket array as laid out, e.g. for writing it out (see
+    // ht-snapshot.h): the item in bucket i, or nullptr, and the position of
+    // capacity() in Capacity::sizes[]. Tombstones have deleted set. Buckets
+    // do not cover the items of a resize in progress.
+    const HashItem* bucket(size_t i) const { return table_[i]; }
+    size_t capacityIndex() const { return index_; }
+    Allocator get_allocator() const { return Allocator(alloc_); }
+
     void reportAll(std::ostream& out) const {
         for (size_t i = 0; i < table_.size(); ++i) {
             if (table_[i] && !table_[i]->deleted)
@@ -170,66 +757,472 @@ public:
                     << table_[i]->item.first << " -> "
                     << table_[i]->item.second << "\n";
         }
+        for (size_t i = 0; i < old_.size(); ++i) {
+            HashItem* p = old_[i];
+            if (p && p != moved() && !p->deleted)
+                out << "Old bucket " << i << ": "
+                    << p->item.first << " -> " << p->item.second << "\n";
+        }
+    }
+
+    // Batch operations: the keys of each block are hashed up front and
+    // their home buckets prefetched, so the bucket loads of a block overlap
+    // instead of stalling one after another.
+    void insertBatch(const ItemType* items, size_t n) {
+        HASH_INDEX_T h[BATCH_BLOCK];
+        for (size_t b = 0; b < n; b += BATCH_BLOCK) {
+            size_t k = n - b < BATCH_BLOCK ? n - b : BATCH_BLOCK;
+            for (size_t i = 0; i < k; ++i) {
+                h[i] = hash_(items[b + i].first);
+                HT_PREFETCH(&table_[Capacity::home(h[i], table_.size())]);
+            }
+            for (size_t i = 0; i < k; ++i)
+                insert(items[b + i], h[i]);
+        }
+    }
+
+    // out[i] receives find(keys[i])
+    void findBatch(const KeyType* keys, size_t n, ItemType** out) {
+        HashItem* items[BATCH_BLOCK];
+        for (size_t b = 0; b < n; b += BATCH_BLOCK) {
+            size_t k = n - b < BATCH_BLOCK ? n - b : BATCH_BLOCK;
+            internalFindBatch(keys + b, k, items);
+            for (size_t i = 0; i < k; ++i)
+                out[b + i] = items[i] ? &items[i]->item : nullptr;
+        }
+    }
+    void findBatch(const KeyType* keys, size_t n, const ItemType** out) const {
+        HashItem* items[BATCH_BLOCK];
+        for (size_t b = 0; b < n; b += BATCH_BLOCK) {
+            size_t k = n - b < BATCH_BLOCK ? n - b : BATCH_BLOCK;
+            internalFindBatch(keys + b, k, items);
+            for (size_t i = 0; i < k; ++i)
+                out[b + i] = items[i] ? &items[i]->item : nullptr;
+        }
     }
 
     void clearTotalProbes() { totalProbes_ = 0; }
     size_t totalProbes() const { return totalProbes_; }
 
+#ifdef HT_STATS
+    const HashTableStats& stats() const { return stats_; }
+    void clearStats() { stats_.clear(); }
+    size_t tombstones() const { return used_ - (count_ - oldCount_); }
+    double loadFactor() const { return double(count_) / table_.size(); }
+    size_t longestCluster() const {
+        const std::vector<HashItem*>& t = table_;
+        return ::longestCluster(t.size(), [&t](size_t i) { return t[i] != nullptr; });
+    }
+    void reportStats(std::ostream& out) const {
+        out << "size " << count_ << ", capacity " << table_.size()
+            << ", load " << loadFactor() << ", tombstones " << tombstones()
+            << ", longest cluster " << longestCluster() << "\n";
+        stats_.report(out);
+    }
+#endif
+
 private:
-    static const HASH_INDEX_T sizes[];
+    typedef typename ProberType::Capacity Capacity;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<HashItem> NodeAllocator;
+    typedef std::allocator_traits<NodeAllocator> NodeTraits;
     static const HASH_INDEX_T npos = ProberType::npos;
+    static const size_t BATCH_BLOCK = 16;
+
+    template <typename... Args>
+    HashItem* newItem(Args&&... args) {
+        HashItem* p = NodeTraits::allocate(alloc_, 1);
+        try {
+            NodeTraits::construct(alloc_, p, std::forward<Args>(args)...);
+        } catch (...) {
+            NodeTraits::deallocate(alloc_, p, 1);
+            throw;
+        }
+        return p;
+    }
+
+    void deleteItem(HashItem* p) {
+        NodeTraits::destroy(alloc_, p);
+        NodeTraits::deallocate(alloc_, p, 1);
+    }
+
+    // P is ItemType, possibly const and always a reference: an rvalue item
+    // is moved into its node, or its value moved over the existing one.
+    template <typename P>
+    void insert(P&& p, HASH_INDEX_T h) {
+        HASH_INDEX_T ph;
+        bool found;
+        HASH_INDEX_T loc = insertSlot(p.first, h, ph, found);
+        if (!found) fill(loc, newItem(std::in_place, std::forward<P>(p)), h, ph);
+        else table_[loc]->item.second = std::forward<P>(p).second;
+    }
+
+    template <typename Key, typename... Args>
+    std::pair<ItemType*, bool> tryEmplace(Key&& key, Args&&... args) {
+        HASH_INDEX_T h = hash_(key), ph;
+        bool found;
+        HASH_INDEX_T loc = insertSlot(key, h, ph, found);
+        if (found) return std::make_pair(&table_[loc]->item, false);
+        HashItem* p = newItem(std::in_place, std::piecewise_construct,
+                              std::forward_as_tuple(std::forward<Key>(key)),
+                              std::forward_as_tuple(std::forward<Args>(args)...));
+        return std::make_pair(&fill(loc, p, h, ph)->item, true);
+    }
+
+    template <typename Key, typename M>
+    std::pair<ItemType*, bool> insertOrAssign(Key&& key, M&& value) {
+        HASH_INDEX_T h = hash_(key), ph;
+        bool found;
+        HASH_INDEX_T loc = insertSlot(key, h, ph, found);
+        if (found) {
+            table_[loc]->item.second = std::forward<M>(value);
+            return std::make_pair(&table_[loc]->item, false);
+        }
+        HashItem* p = newItem(std::in_place, std::forward<Key>(key), std::forward<M>(value));
+        return std::make_pair(&fill(loc, p, h, ph)->item, true);
+    }
+
+    // The bucket an insert of key stops at: key's own (found), or where its
+    // new item goes: an empty bucket or, in Robin Hood order, the first
+    // item nearer its home, which fill() moves along. Resizes first if the
+    // load factor is >= alpha, unless that is mostly tombstones, in which
+    // case dropping them is enough. ph receives the prober's keyHash(key)
+    // (0 unless it sets hashedInit). During an incremental resize key is
+    // first moved out of the old buckets.
+    HASH_INDEX_T insertSlot(const KeyType& key, HASH_INDEX_T h, HASH_INDEX_T& ph, bool& found) {
+        if (double(used_) / table_.size() >= alpha_) {
+            finishResize();
+            if (rehashIsEnough()) rehash();
+            else resize();
+        }
+        if (resizing()) migrateFor(key, h);
+        HT_STATS_ONLY(size_t before = totalProbes_;)
+        HASH_INDEX_T m = table_.size();
+        ph = probeKeyHash(prober_, key);
+        HASH_INDEX_T loc;
+        if (ProberType::robinHood) {
+            loc = robinHoodSlot(key, h, found);
+        } else {
+            startProbe(prober_, Capacity::home(h, m), m, ph, key);
+            loc = probeFrom(key, h);
+            found = loc != npos && table_[loc];
+        }
+        HT_STATS_ONLY(stats_.record(HashTableStats::INSERT, totalProbes_ - before);)
+        if (loc == npos)
+            throw std::logic_error("HashTable full");
+        return loc;
+    }
+
+    HASH_INDEX_T robinHoodSlot(const KeyType& key, HASH_INDEX_T h, bool& found) const {
+        HASH_INDEX_T m = table_.size();
+        HASH_INDEX_T loc = Capacity::home(h, m);
+        found = false;
+        for (size_t d = 0; d < m; ++d, loc = Capacity::wrap(loc + 1, m)) {
+            ++totalProbes_;
+            HashItem* pi = table_[loc];
+            if (!pi) return loc;
+            if (pi->hashMayMatch(h) && eq_(pi->item.first, key)) {
+                found = true;
+                return loc;
+            }
+            // key would sit here if it were in the table; its item takes
+            // pi's place as long as there is an empty bucket to shift into
+            if (distance(pi, loc) < d) return used_ < m ? loc : npos;
+        }
+        return npos;
+    }
+
+    // Put the new item p into bucket loc from insertSlot().
+    HashItem* fill(HASH_INDEX_T loc, HashItem* p, HASH_INDEX_T h, HASH_INDEX_T ph) {
+        if (table_[loc]) shiftUp(loc);
+        table_[loc] = p;
+        p->setHash(h, ph);
+        ++count_; ++used_;
+        return p;
+    }
 
     HASH_INDEX_T probe(const KeyType& key) const {
-        HASH_INDEX_T h0 = hash_(key) % sizes[index_];
-        prober_.init(h0, sizes[index_], key);
-        for (size_t i = 0; i < sizes[index_]; ++i) {
+        return probe(key, hash_(key));
+    }
+
+    HASH_INDEX_T probe(const KeyType& key, HASH_INDEX_T h) const {
+        HASH_INDEX_T m = Capacity::sizes[index_];
+        HASH_INDEX_T h0 = Capacity::home(h, m);
+        prober_.init(h0, m, key);
+        return probeFrom(key, h);
+    }
+
+    // Run the already initialized prober until key or an empty bucket.
+    template <typename Q>
+    HASH_INDEX_T probeFrom(const Q& key, HASH_INDEX_T h) const {
+        HASH_INDEX_T m = table_.size();
+        for (size_t i = 0; i < m; ++i) {
             HASH_INDEX_T loc = prober_.next();
             ++totalProbes_;
             if (loc == npos) return npos;
             auto pi = table_[loc];
-            if (!pi || (!pi->deleted && eq_(pi->item.first, key)))
+            if (!pi || (!pi->deleted && pi->hashMayMatch(h) && eq_(pi->item.first, key)))
                 return loc;
+            // in Robin Hood order key would have been placed before pi
+            if (ProberType::robinHood && distance(pi, loc) < i) return npos;
         }
         return npos;
     }
 
     HashItem* internalFind(const KeyType& key) const {
-        HASH_INDEX_T loc = probe(key);
-        if (loc == npos) return nullptr;
-        auto p = table_[loc];
-        return (p && !p->deleted)? p : nullptr;
+        return internalFind(key, hash_(key));
     }
 
+    HashItem* internalFind(const KeyType& key, HASH_INDEX_T h) const {
+        HT_STATS_ONLY(size_t before = totalProbes_;)
+        HASH_INDEX_T loc = probe(key, h);
+        HashItem* p = loc == npos ? nullptr : table_[loc];
+        if (p && p->deleted) p = nullptr;
+        if (!p && resizing()) p = findOld(key, h, probeKeyHash(prober_, key));
+        HT_STATS_ONLY(stats_.record(p ? HashTableStats::HIT : HashTableStats::MISS,
+                                    totalProbes_ - before);)
+        return p;
+    }
+
+    // internalFind() with the prober started from a known keyHash()
+    template <typename Q>
+    HashItem* internalFindHashed(const Q& key, HASH_INDEX_T h, HASH_INDEX_T ph) const {
+        HT_STATS_ONLY(size_t before = totalProbes_;)
+        HASH_INDEX_T m = table_.size();
+        startProbe(prober_, Capacity::home(h, m), m, ph, key);
+        HASH_INDEX_T loc = probeFrom(key, h);
+        HashItem* p = loc == npos ? nullptr : table_[loc];
+        if (p && p->deleted) p = nullptr;
+        if (!p && resizing()) p = findOld(key, h, ph);
+        HT_STATS_ONLY(stats_.record(p ? HashTableStats::HIT : HashTableStats::MISS,
+                                    totalProbes_ - before);)
+        return p;
+    }
+
+    // probeFrom() over the old buckets of an incremental resize, which
+    // hold moved() where an item has already gone across
+    template <typename Q>
+    HASH_INDEX_T probeOld(const Q& key, HASH_INDEX_T h, HASH_INDEX_T ph) const {
+        HASH_INDEX_T m = old_.size();
+        startProbe(prober_, Capacity::home(h, m), m, ph, key);
+        for (size_t i = 0; i < m; ++i) {
+            HASH_INDEX_T loc = prober_.next();
+            ++totalProbes_;
+            if (loc == npos) return npos;
+            HashItem* pi = old_[loc];
+            if (!pi) return npos;
+            if (pi == moved()) continue;
+            if (!pi->deleted && pi->hashMayMatch(h) && eq_(pi->item.first, key))
+                return loc;
+            if (ProberType::robinHood && distance(pi, loc, m) < i) return npos;
+        }
+        return npos;
+    }
+
+    template <typename Q>
+    HashItem* findOld(const Q& key, HASH_INDEX_T h, HASH_INDEX_T ph) const {
+        HASH_INDEX_T loc = probeOld(key, h, ph);
+        return loc == npos ? nullptr : old_[loc];
+    }
+
+    // One step of an incremental resize ahead of an insert or remove of
+    // key, which is then in the new buckets if it is in the table at all.
+    template <typename Q>
+    void migrateFor(const Q& key, HASH_INDEX_T h) {
+        migrate(migrateStep_);
+        if (!resizing()) return;
+        HASH_INDEX_T loc = probeOld(key, h, probeKeyHash(prober_, key));
+        if (loc == npos) return;
+        HashItem* p = old_[loc];
+        old_[loc] = moved();
+        --oldCount_;
+        relink(p);
+    }
+
+    // Move the items of the next n old buckets into the new ones.
+    void migrate(size_t n) {
+        for (; n > 0 && migrated_ < old_.size(); --n, ++migrated_) {
+            HashItem* p = old_[migrated_];
+            if (!p || p == moved()) continue;
+            old_[migrated_] = moved();
+            if (p->deleted) { deleteItem(p); continue; }
+            --oldCount_;
+            relink(p);
+        }
+        if (migrated_ == old_.size()) {
+            std::vector<HashItem*>().swap(old_);
+            migrated_ = 0;
+        }
+    }
+
+    // marks an old bucket whose item has moved; never dereferenced
+    static HashItem* moved() {
+        static char tag;
+        return reinterpret_cast<HashItem*>(&tag);
+    }
+
+    // Look up k <= BATCH_BLOCK keys: hash them all, prefetch their home
+    // buckets, then prefetch the items those buckets point to, then probe.
+    void internalFindBatch(const KeyType* keys, size_t k, HashItem** out) const {
+        HASH_INDEX_T h[BATCH_BLOCK];
+        HASH_INDEX_T m = table_.size();
+        hashKeys(hash_, keys, k, h);
+        for (size_t i = 0; i < k; ++i)
+            HT_PREFETCH(&table_[Capacity::home(h[i], m)]);
+        for (size_t i = 0; i < k; ++i)
+            HT_PREFETCH(table_[Capacity::home(h[i], m)]);
+        for (size_t i = 0; i < k; ++i)
+            out[i] = internalFind(keys[i], h[i]);
+    }
+
+    template<typename It>
+    void reserveFor(It first, It last, std::forward_iterator_tag) {
+        reserve(size() + std::distance(first, last));
+    }
+    template<typename It>
+    void reserveFor(It, It, std::input_iterator_tag) {}
+
     void resize() {
-        if (index_ + 1 >= sizeof(sizes)/sizeof(HASH_INDEX_T))
+        if (index_ + 1 >= Capacity::count)
             throw std::logic_error("No more capacities");
-        auto old = table_;
-        ++index_;
-        table_.assign(sizes[index_], nullptr);
+        if (migrateStep_) startResize(index_ + 1);
+        else rebuild(index_ + 1);
+    }
+
+    // Switch to capacity sizes[newIndex], leaving every item in what are
+    // now the old buckets.
+    void startResize(size_t newIndex) {
+        HT_STATS_ONLY(ResizeTimer timer(stats_);)
+        old_.assign(Capacity::sizes[newIndex], nullptr);
+        old_.swap(table_);
+        index_ = newIndex;
+        oldCount_ = count_;
+        used_ = 0;
+        migrated_ = 0;
+    }
+
+    // Whether the live items, with the one being inserted, fill at most
+    // alpha/2 of the current capacity, which is where a resize would leave
+    // them. The capacity then follows the live count rather than used_: a
+    // table whose size holds steady under churn rehashes in place once it
+    // reaches the first capacity with that much room, instead of climbing
+    // sizes[] with its tombstones. The next rebuild is at least alpha/2 of
+    // the capacity inserts away, so rebuilds stay O(1) per insert.
+    bool rehashIsEnough() const {
+        return 2.0 * (count_ - oldCount_ + 1) <= alpha_ * table_.size();
+    }
+
+    // Rebuild at capacity sizes[newIndex], dropping tombstones. Live items
+    // are relinked into the new bucket array rather than copied.
+    void rebuild(size_t newIndex) {
+        finishResize();
+        HT_STATS_ONLY(ResizeTimer timer(stats_);)
+        std::vector<HashItem*> old(Capacity::sizes[newIndex], nullptr);
+        old.swap(table_);
+        index_ = newIndex;
         count_ = used_ = 0;
         for (auto p : old) {
-            if (p && !p->deleted) insert(p->item);
-            delete p;
+            if (!p) continue;
+            if (p->deleted) { deleteItem(p); continue; }
+            relink(p);
+            ++count_;
         }
     }
 
+    // Put the live item p, whose key is in no bucket yet, into the table.
+    void relink(HashItem* p) {
+        if (ProberType::robinHood) placeRobinHood(p);
+        else table_[place(p, std::integral_constant<bool, CacheHash<K>::value>())] = p;
+        ++used_;
+    }
+
+    HASH_INDEX_T place(HashItem* p, std::false_type) const {
+        return probe(p->item.first);
+    }
+
+    // With cached hashes no key is hashed or compared: the keys are known
+    // to be distinct, so the first empty bucket is the spot.
+    HASH_INDEX_T place(HashItem* p, std::true_type) const {
+        HASH_INDEX_T m = table_.size();
+        startProbe(prober_, Capacity::home(p->hash, m), m, p->probeHash, p->item.first);
+        for (;;) {
+            HASH_INDEX_T loc = prober_.next();
+            ++totalProbes_;
+            if (loc == npos) throw std::logic_error("HashTable full");
+            if (!table_[loc]) return loc;
+        }
+    }
+
+    // Robin Hood placement of an item known not to be in the table
+    void placeRobinHood(HashItem* p) {
+        HASH_INDEX_T m = table_.size();
+        HASH_INDEX_T loc = Capacity::home(itemHash(p), m);
+        for (size_t d = 0; table_[loc] && distance(table_[loc], loc) >= d; ++d) {
+            ++totalProbes_;
+            loc = Capacity::wrap(loc + 1, m);
+        }
+        if (table_[loc]) shiftUp(loc);
+        table_[loc] = p;
+    }
+
+    // Move the run of items starting at loc up one bucket, into the first
+    // empty bucket after it, and empty loc.
+    void shiftUp(HASH_INDEX_T loc) {
+        HASH_INDEX_T m = table_.size();
+        HashItem* carry = nullptr;
+        for (HASH_INDEX_T i = loc; carry || i == loc; i = Capacity::wrap(i + 1, m))
+            std::swap(carry, table_[i]);
+    }
+
+    // Remove the live item p: a tombstone, or in Robin Hood order, shift
+    // the items after it that are away from home back one bucket.
+    void erase(HashItem* p) {
+        --count_;
+        if (!ProberType::robinHood) {
+            p->deleted = true;
+            return;
+        }
+        HASH_INDEX_T m = table_.size();
+        HASH_INDEX_T loc = Capacity::home(itemHash(p), m);
+        while (table_[loc] != p) loc = Capacity::wrap(loc + 1, m);
+        for (HASH_INDEX_T next = Capacity::wrap(loc + 1, m);
+             table_[next] && distance(table_[next], next) > 0;
+             loc = next, next = Capacity::wrap(next + 1, m))
+            table_[loc] = table_[next];
+        table_[loc] = nullptr;
+        --used_;
+        deleteItem(p);
+    }
+
+    HASH_INDEX_T itemHash(const HashItem* p) const {
+        return itemHash(p, std::integral_constant<bool, CacheHash<K>::value>());
+    }
+    HASH_INDEX_T itemHash(const HashItem* p, std::true_type) const { return p->hash; }
+    HASH_INDEX_T itemHash(const HashItem* p, std::false_type) const { return hash_(p->item.first); }
+
+    // How far bucket loc is from the home of its item p, in a bucket array
+    // of size m
+    HASH_INDEX_T distance(const HashItem* p, HASH_INDEX_T loc) const {
+        return distance(p, loc, table_.size());
+    }
+    HASH_INDEX_T distance(const HashItem* p, HASH_INDEX_T loc, HASH_INDEX_T m) const {
+        return Capacity::wrap(loc + m - Capacity::home(itemHash(p), m), m);
+    }
+
     mutable ProberType         prober_;
     Hasher                     hash_;
     KeyEqual                   eq_;
+    NodeAllocator              alloc_;
     double                     alpha_;
     mutable size_t             totalProbes_;
     size_t                     index_, count_, used_;
     std::vector<HashItem*>     table_;
-};
-
-template<typename K,typename V,typename P,typename H,typename E>
-const HASH_INDEX_T HashTable<K,V,P,H,E>::sizes[] = {
-    11,23,47,97,197,397,797,1597,
-    3203,6421,12853,25717,51437,102877,
-    205759,411527,823117,1646237,3292489,
-    6584983,13169977,26339969,52679969,
-    105359969,210719881,421439783,
-    842879579,1685759167
+    // during an incremental resize: the old buckets, the next one to move
+    // and the live items still in them
+    std::vector<HashItem*>     old_;
+    size_t                     migrated_, oldCount_, migrateStep_;
+#ifdef HT_STATS
+    mutable HashTableStats     stats_;
+#endif
 };
 
 #endif // HT_H
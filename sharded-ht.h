@@ -0,0 +1,209 @@
+#ifndef SHARDED_HT_H
+#define SHARDED_HT_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <utility>
+#include <functional>
+
+#include "ht.h"
+
+// ------------------------- ShardedHashTable --------------------------------
+//
+// N independent HashTables, each behind its own mutex. A key goes to the
+// shard picked by the high bits of its mixed hash, and the shard's table
+// then places it by that same hash instead of hashing the key again (its
+// low bits, or a modulo, are unrelated to the high mixed bits). Operations on
+// different shards never wait for each other, and a resize only rebuilds
+// (and only blocks) one shard, holding about 1/N of the items.
+//
+// insertBatch() hashes the items in parallel, sorts them by shard, sizes
+// each shard once for its share and then fills whole shards on separate
+// threads, so bulk loads scale without any lock contention.
+//
+// Lookups lock their shard too (HashTable lookups update its prober), so
+// they return copies rather than pointers into a table another thread may
+// be changing.
+
+template<
+    typename K,
+    typename V,
+    typename ProberType = LinearProber<K>,
+    typename Hash       = std::hash<K>,
+    typename KeyEqual   = std::equal_to<K>
+>
+class ShardedHashTable {
+public:
+    using KeyType   = K;
+    using ValueType = V;
+    using ItemType  = std::pair<KeyType,ValueType>;
+    using Hasher    = Hash;
+    typedef HashTable<K, V, ProberType, Hash, KeyEqual> ShardType;
+
+    static const size_t DEFAULT_SHARDS = 16;
+
+    // shards is rounded up to a power of two
+    ShardedHashTable(double alpha = 0.4,
+                     const ProberType& prober = ProberType(),
+                     const Hasher& hash     = Hasher(),
+                     const KeyEqual& eq     = KeyEqual(),
+                     size_t shards          = DEFAULT_SHARDS)
+      : hash_(hash)
+      , shardBits_(0)
+    {
+        while ((size_t(1) << shardBits_) < shards) ++shardBits_;
+        for (size_t i = 0; i < (size_t(1) << shardBits_); ++i)
+            shards_.emplace_back(new Shard(alpha, prober, hash, eq));
+    }
+
+    ShardedHashTable(const ShardedHashTable&) = delete;
+    ShardedHashTable& operator=(const ShardedHashTable&) = delete;
+
+    size_t shardCount() const { return shards_.size(); }
+
+    // Which shard a key lives in.
+    size_t shardOf(const KeyType& key) const { return shardIndex(hash_(key)); }
+
+    // Direct access to one shard's table, e.g. for its statistics. Only
+    // safe while no other thread uses the table.
+    const ShardType& shard(size_t i) const { return shards_[i]->table; }
+
+    // Sum over the shards; only a snapshot while writers are running.
+    size_t size() const {
+        size_t n = 0;
+        for (const auto& s : shards_) {
+            std::lock_guard<std::mutex> lock(s->lock);
+            n += s->table.size();
+        }
+        return n;
+    }
+    bool empty() const { return size() == 0; }
+
+    // Insert p, or replace the value of an existing key.
+    void insert(const ItemType& p) {
+        HASH_INDEX_T h = hash_(p.first);
+        Shard& s = *shards_[shardIndex(h)];
+        std::lock_guard<std::mutex> lock(s.lock);
+        s.table.insertByHash(h, p);
+    }
+
+    void remove(const KeyType& key) {
+        Shard& s = *shards_[shardOf(key)];
+        std::lock_guard<std::mutex> lock(s.lock);
+        s.table.remove(key);
+    }
+
+    bool contains(const KeyType& key) const {
+        HASH_INDEX_T h = hash_(key);
+        Shard& s = *shards_[shardIndex(h)];
+        std::lock_guard<std::mutex> lock(s.lock);
+        return s.table.findByHash(h, key) != nullptr;
+    }
+
+    // Copy out the value of key, if it is there.
+    bool lookup(const KeyType& key, ValueType& out) const {
+        HASH_INDEX_T h = hash_(key);
+        Shard& s = *shards_[shardIndex(h)];
+        std::lock_guard<std::mutex> lock(s.lock);
+        const ItemType* p = s.table.findByHash(h, key);
+        if (!p) return false;
+        out = p->second;
+        return true;
+    }
+
+    // Grow every shard to take its share of n items.
+    void reserve(size_t n) {
+        size_t share = n / shards_.size() + n / (4 * shards_.size()) + 1;
+        for (auto& s : shards_) {
+            std::lock_guard<std::mutex> lock(s->lock);
+            s->table.reserve(share);
+        }
+    }
+
+    // Insert n items on up to threads threads (0: one per core). Safe to
+    // run alongside other operations; each shard is locked while it is
+    // being filled. Of duplicate keys in items the last one wins, as if they
+    // went in one by one.
+    void insertBatch(const ItemType* items, size_t n, unsigned threads = 0) {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        // hash in blocks handed out on demand
+        std::vector<HASH_INDEX_T> h(n);
+        std::atomic<size_t> nextBlock(0);
+        runWorkers(threads, [&]{
+            for (size_t b; (b = nextBlock.fetch_add(HASH_BLOCK)) < n; ) {
+                size_t e = std::min(n, b + HASH_BLOCK);
+                for (size_t i = b; i < e; ++i) h[i] = hash_(items[i].first);
+            }
+        });
+
+        // counting sort of the item indices by shard
+        size_t count = shards_.size();
+        std::vector<size_t> start(count + 1, 0);
+        for (size_t i = 0; i < n; ++i) ++start[shardIndex(h[i]) + 1];
+        for (size_t s = 0; s < count; ++s) start[s + 1] += start[s];
+        std::vector<size_t> order(n);
+        std::vector<size_t> fill(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < n; ++i) order[fill[shardIndex(h[i])]++] = i;
+
+        // whole shards handed out on demand
+        std::atomic<size_t> nextShard(0);
+        runWorkers(threads, [&]{
+            for (size_t s; (s = nextShard.fetch_add(1)) < count; ) {
+                Shard& sh = *shards_[s];
+                std::lock_guard<std::mutex> lock(sh.lock);
+                sh.table.reserve(sh.table.size() + (start[s + 1] - start[s]));
+                for (size_t k = start[s]; k < start[s + 1]; ++k)
+                    sh.table.insertByHash(h[order[k]], items[order[k]]);
+            }
+        });
+    }
+
+private:
+    static const size_t HASH_BLOCK = 4096;
+
+    struct Shard {
+        mutable std::mutex lock;
+        // mutable: lookups through a const table still use the prober
+        mutable ShardType  table;
+        Shard(double alpha, const ProberType& prober, const Hasher& hash, const KeyEqual& eq)
+          : table(alpha, prober, hash, eq) {}
+    };
+
+    size_t shardIndex(HASH_INDEX_T h) const {
+        if (shardBits_ == 0) return 0;
+        return PowerOfTwoCapacity::mix(h) >> (8 * sizeof(HASH_INDEX_T) - shardBits_);
+    }
+
+    // Run f on threads threads, the caller's included, and rethrow the
+    // first exception any of them threw.
+    template <typename F>
+    static void runWorkers(unsigned threads, F f) {
+        std::exception_ptr error;
+        std::mutex errorLock;
+        auto guarded = [&]{
+            try { f(); }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(errorLock);
+                if (!error) error = std::current_exception();
+            }
+        };
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t) pool.emplace_back(guarded);
+        guarded();
+        for (std::thread& th : pool) th.join();
+        if (error) std::rethrow_exception(error);
+    }
+
+    Hasher                              hash_;
+    unsigned                            shardBits_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+#endif // SHARDED_HT_H
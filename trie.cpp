@@ -0,0 +1,273 @@
+#ifndef RECCHECK
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "trie.h"
+
+const Trie::NodeIndex Trie::npos;
+const uint32_t Trie::WORD_BIT;
+
+// Layout of a compiled trie file; the node array follows directly.
+struct TrieFileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t wordCount;
+    uint32_t reserved;
+};
+
+static const char TRIE_MAGIC[8] = {'B','O','G','T','R','I','E','\0'};
+static const uint32_t TRIE_VERSION = 1;
+
+Trie::Trie()
+    : storage_(1, TrieNode{0, 0}), nodes_(storage_.data()), numNodes_(1), numWords_(0),
+      map_(nullptr), mapLen_(0)
+{
+}
+
+Trie::Trie(const Trie& other)
+    : storage_(other.nodes_, other.nodes_ + other.numNodes_), nodes_(storage_.data()),
+      numNodes_(other.numNodes_), numWords_(other.numWords_), map_(nullptr), mapLen_(0)
+{
+}
+
+Trie::Trie(Trie&& other)
+    : Trie()
+{
+    swap(other);
+}
+
+Trie& Trie::operator=(Trie other)
+{
+    swap(other);
+    return *this;
+}
+
+Trie::~Trie()
+{
+    if(map_)
+        munmap(map_, mapLen_);
+}
+
+void Trie::swap(Trie& other)
+{
+    // swapping vectors keeps their buffers, so nodes_ stays valid
+    storage_.swap(other.storage_);
+    std::swap(nodes_, other.nodes_);
+    std::swap(numNodes_, other.numNodes_);
+    std::swap(numWords_, other.numWords_);
+    std::swap(map_, other.map_);
+    std::swap(mapLen_, other.mapLen_);
+}
+
+Trie::Trie(std::vector<std::string> words)
+    : storage_(1, TrieNode{0, 0}), numWords_(0), map_(nullptr), mapLen_(0)
+{
+    // normalize to upper case; buildAll drops anything else
+    std::vector<TrieWord> spans;
+    spans.reserve(words.size());
+    for(size_t i = 0; i < words.size(); ++i){
+        std::string& w = words[i];
+        for(size_t j = 0; j < w.size(); ++j)
+            w[j] = std::toupper(static_cast<unsigned char>(w[j]));
+        spans.push_back(TrieWord{w.data(), w.size()});
+    }
+    buildAll(spans);
+}
+
+Trie::Trie(std::vector<TrieWord> words)
+    : storage_(1, TrieNode{0, 0}), numWords_(0), map_(nullptr), mapLen_(0)
+{
+    buildAll(words);
+}
+
+// past this many ascending runs the input counts as unsorted
+static const size_t MAX_MERGE_RUNS = 64;
+
+void sortWords(std::vector<TrieWord>& words)
+{
+    size_t n = words.size();
+    // start of each ascending run, then n
+    std::vector<size_t> runs(1, 0);
+    for(size_t i = 1; i < n && runs.size() <= MAX_MERGE_RUNS; ++i)
+        if(words[i] < words[i-1])
+            runs.push_back(i);
+    runs.push_back(n);
+
+    if(runs.size() <= MAX_MERGE_RUNS + 1){
+        // already sorted, or a few sorted runs (dict.txt is sorted by length
+        // and then alphabetically): merge neighbouring runs pairwise
+        while(runs.size() > 2){
+            std::vector<size_t> merged(1, 0);
+            for(size_t r = 0; r + 1 < runs.size(); r += 2){
+                size_t hi = runs[std::min(r + 2, runs.size() - 1)];
+                std::inplace_merge(words.begin() + runs[r], words.begin() + runs[r+1],
+                                   words.begin() + hi);
+                merged.push_back(hi);
+            }
+            runs.swap(merged);
+        }
+    }
+    else{
+        unsigned threads = std::thread::hardware_concurrency();
+        if(threads > 1 && n >= 65536){
+            // sort equal chunks in parallel, then merge neighbours pairwise
+            size_t chunk = (n + threads - 1) / threads;
+            std::vector<std::thread> pool;
+            for(size_t lo = 0; lo < n; lo += chunk)
+                pool.emplace_back([&words, lo, chunk, n]{
+                    std::sort(words.begin() + lo, words.begin() + std::min(lo + chunk, n));
+                });
+            for(std::thread& t : pool)
+                t.join();
+            for(size_t width = chunk; width < n; width *= 2)
+                for(size_t lo = 0; lo + width < n; lo += 2 * width)
+                    std::inplace_merge(words.begin() + lo, words.begin() + lo + width,
+                                       words.begin() + std::min(lo + 2 * width, n));
+        }
+        else
+            std::sort(words.begin(), words.end());
+    }
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+}
+
+// Drop the words the node layout cannot hold, then sort (only pointers
+// move) and build.
+void Trie::buildAll(std::vector<TrieWord>& words)
+{
+    size_t kept = 0;
+    for(size_t i = 0; i < words.size(); ++i){
+        const TrieWord& w = words[i];
+        bool ok = w.len != 0;
+        for(size_t j = 0; ok && j < w.len; ++j)
+            ok = w.p[j] >= 'A' && w.p[j] <= 'Z';
+        if(ok) words[kept++] = w;
+    }
+    words.resize(kept);
+    sortWords(words);
+
+    storage_.reserve(words.size() * 2 + 1);
+    build(root(), words, 0, words.size(), 0);
+    nodes_ = storage_.data();
+    numNodes_ = storage_.size();
+}
+
+// Words in [lo, hi) are sorted and share their first depth letters. All the
+// children of node are allocated as one block before recursing into any of
+// them, which is what keeps siblings contiguous.
+void Trie::build(NodeIndex node, const std::vector<TrieWord>& words,
+                 size_t lo, size_t hi, size_t depth)
+{
+    // a word that ends here sorts before every longer word with the prefix
+    if(lo < hi && words[lo].len == depth){
+        storage_[node].childMask |= WORD_BIT;
+        ++numWords_;
+        ++lo;
+    }
+    if(lo == hi)
+        return;
+
+    uint32_t mask = 0;
+    for(size_t i = lo; i < hi; ++i)
+        mask |= 1u << (words[i].p[depth] - 'A');
+
+    NodeIndex first = static_cast<NodeIndex>(storage_.size());
+    storage_.resize(first + __builtin_popcount(mask), TrieNode{0, 0});
+    storage_[node].childMask |= mask;
+    storage_[node].firstChild = first;
+
+    NodeIndex next = first;
+    size_t start = lo;
+    for(size_t i = lo + 1; i <= hi; ++i){
+        if(i == hi || words[i].p[depth] != words[start].p[depth]){
+            build(next++, words, start, i, depth + 1);
+            start = i;
+        }
+    }
+}
+
+Trie::NodeIndex Trie::find(const std::string& s) const
+{
+    NodeIndex n = root();
+    for(size_t i = 0; i < s.size() && n != npos; ++i)
+        n = child(n, s[i]);
+    return n;
+}
+
+void Trie::save(const std::string& fname) const
+{
+    TrieFileHeader hdr;
+    std::memcpy(hdr.magic, TRIE_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRIE_VERSION;
+    hdr.nodeCount = static_cast<uint32_t>(numNodes_);
+    hdr.wordCount = static_cast<uint32_t>(numWords_);
+    hdr.reserved = 0;
+
+    std::ofstream out(fname, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    out.write(reinterpret_cast<const char*>(nodes_), numNodes_ * sizeof(TrieNode));
+    if(out.fail())
+        throw std::runtime_error("unable to write compiled dictionary");
+}
+
+bool Trie::isCompiled(const std::string& fname)
+{
+    char magic[sizeof(TRIE_MAGIC)];
+    std::ifstream in(fname, std::ios::binary);
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, TRIE_MAGIC, sizeof(magic)) == 0;
+}
+
+Trie Trie::load(const std::string& fname)
+{
+    int fd = open(fname.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::invalid_argument("unable to open dictionary file");
+    struct stat st;
+    if(fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(TrieFileHeader)){
+        close(fd);
+        throw std::invalid_argument("not a compiled dictionary");
+    }
+    size_t len = st.st_size;
+    void* map = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED)
+        throw std::invalid_argument("unable to map dictionary file");
+
+    const TrieFileHeader* hdr = static_cast<const TrieFileHeader*>(map);
+    if(std::memcmp(hdr->magic, TRIE_MAGIC, sizeof(TRIE_MAGIC)) != 0 ||
+       hdr->version != TRIE_VERSION || hdr->nodeCount == 0 ||
+       len != sizeof(TrieFileHeader) + size_t(hdr->nodeCount) * sizeof(TrieNode)){
+        munmap(map, len);
+        throw std::invalid_argument("not a compiled dictionary");
+    }
+    // child() trusts every child block to lie inside the node array, and
+    // the letter bits to be the only ones set besides WORD_BIT
+    const TrieNode* nodes = reinterpret_cast<const TrieNode*>(hdr + 1);
+    for(uint32_t i = 0; i < hdr->nodeCount; ++i){
+        uint32_t letters = nodes[i].childMask & ~WORD_BIT;
+        if((letters >> 26) != 0 ||
+           uint64_t(nodes[i].firstChild) + __builtin_popcount(letters) > hdr->nodeCount){
+            munmap(map, len);
+            throw std::invalid_argument("not a compiled dictionary");
+        }
+    }
+
+    Trie t;
+    t.storage_.clear();
+    t.nodes_ = nodes;
+    t.numNodes_ = hdr->nodeCount;
+    t.numWords_ = hdr->wordCount;
+    t.map_ = map;
+    t.mapLen_ = len;
+    return t;
+}
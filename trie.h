@@ -0,0 +1,140 @@
+#ifndef TRIE_H
+#define TRIE_H
+
+#ifndef RECCHECK
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#endif
+
+// One trie node, 8 bytes. Bit i of childMask is set when the node has a
+// child for letter 'A'+i; the children are stored contiguously in letter
+// order starting at firstChild, so the child for a letter is found with
+// one popcount. Bit 31 marks the end of a word. Nodes hold indices, never
+// pointers, so a node array can be written to disk and used as is.
+struct TrieNode {
+    uint32_t childMask;
+    uint32_t firstChild;
+};
+
+// A word by pointer and length, so a trie can be built straight from a
+// buffer holding the whole dictionary file.
+struct TrieWord {
+    const char* p;
+    size_t len;
+};
+
+// std::string's ordering and equality, inline so sorting stays cheap
+inline bool operator<(const TrieWord& a, const TrieWord& b)
+{
+    size_t n = a.len < b.len ? a.len : b.len;
+    for(size_t i = 0; i < n; ++i)
+        if(a.p[i] != b.p[i])
+            return static_cast<unsigned char>(a.p[i]) < static_cast<unsigned char>(b.p[i]);
+    return a.len < b.len;
+}
+
+inline bool operator==(const TrieWord& a, const TrieWord& b)
+{
+    if(a.len != b.len)
+        return false;
+    for(size_t i = 0; i < a.len; ++i)
+        if(a.p[i] != b.p[i])
+            return false;
+    return true;
+}
+
+// Sort and deduplicate; large unsorted inputs are sorted in parallel
+// chunks and merged.
+void sortWords(std::vector<TrieWord>& words);
+
+// Compact, array-backed trie over the letters A-Z (case-insensitive).
+// Walking one character is a single child() call.
+//
+// A trie can be saved to a flat binary file (a header followed by the node
+// array, native byte order) and loaded back with mmap: the mapped nodes
+// are used in place, so loading does no parsing and processes using the
+// same file share one page-cache copy.
+class Trie {
+public:
+    typedef uint32_t NodeIndex;
+    static const NodeIndex npos = static_cast<NodeIndex>(-1);
+    static const uint32_t WORD_BIT = 1u << 31;
+
+    // a trie holding no words
+    Trie();
+
+    // build from words in any order; duplicates are ignored and words
+    // containing anything but letters are skipped
+    explicit Trie(std::vector<std::string> words);
+
+    // same, from words that are already upper case; the characters must
+    // stay valid until the constructor returns
+    explicit Trie(std::vector<TrieWord> words);
+
+    // copies own their nodes, even when the source is a mapped file
+    Trie(const Trie& other);
+    Trie(Trie&& other);
+    Trie& operator=(Trie other);
+    ~Trie();
+    void swap(Trie& other);
+
+    // write the binary form; throws std::runtime_error on I/O failure
+    void save(const std::string& fname) const;
+
+    // map a file written by save(); throws std::invalid_argument if it
+    // cannot be opened or is not a compiled trie, including one whose nodes
+    // point past the end of the node array
+    static Trie load(const std::string& fname);
+
+    // fname starts with the compiled trie header
+    static bool isCompiled(const std::string& fname);
+
+    NodeIndex root() const { return 0; }
+
+    // child of node for letter c, or npos
+    NodeIndex child(NodeIndex node, char c) const
+    {
+        unsigned idx = static_cast<unsigned>((c | 0x20) - 'a');
+        uint32_t mask = nodes_[node].childMask;
+        if (idx >= 26 || !(mask & (1u << idx)))
+            return npos;
+        return nodes_[node].firstChild + __builtin_popcount(mask & ((1u << idx) - 1));
+    }
+
+    // node ends a dictionary word
+    bool isWord(NodeIndex node) const { return nodes_[node].childMask & WORD_BIT; }
+
+    // node is a proper prefix of some dictionary word
+    bool hasChildren(NodeIndex node) const { return nodes_[node].childMask & ~WORD_BIT; }
+
+    // node reached by walking s from the root, or npos
+    NodeIndex find(const std::string& s) const;
+
+    bool contains(const std::string& word) const
+    {
+        NodeIndex n = find(word);
+        return n != npos && isWord(n);
+    }
+
+    size_t nodeCount() const { return numNodes_; }
+    size_t wordCount() const { return numWords_; }
+    const TrieNode* nodes() const { return nodes_; }
+    bool isMapped() const { return map_ != nullptr; }
+
+private:
+    void buildAll(std::vector<TrieWord>& words);
+    void build(NodeIndex node, const std::vector<TrieWord>& words,
+               size_t lo, size_t hi, size_t depth);
+
+    std::vector<TrieNode> storage_;
+    const TrieNode* nodes_;
+    size_t numNodes_;
+    size_t numWords_;
+    // mmap'd file backing nodes_, if any
+    void* map_;
+    size_t mapLen_;
+};
+
+#endif